@@ -0,0 +1,293 @@
+/*==========================================================================
+
+    alert.cpp
+
+    Implementation of the class that is specified in alert.h.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <stdint.h>
+#include "platform.h"
+
+#include "alert.h"
+#include "lcdterm.h"
+
+// Where we are in an alert packet
+#define ALERT_IDLE 0
+#define ALERT_MODE 1
+#define ALERT_ROW  2
+#define ALERT_SECS 3
+#define ALERT_TEXT 4
+// ...or in an escape sequence, which is no part of one
+#define ALERT_ESC_CMD    5
+#define ALERT_ESC_PARAMS 6
+
+/**
+ * AlertOverlay constructor
+ */
+AlertOverlay::AlertOverlay (CharacterMatrix &cm) :
+    cm (cm),
+    state (ALERT_IDLE),
+    esc_left (0),
+    pending (false),
+    shown (false),
+    row (0),
+    len (0),
+    secs (0),
+    shown_at (0),
+    backlight (true),
+    flashes (0),
+    flash_last (0)
+  {
+  }
+
+/**
+ * take
+ * An escape sequence is followed the way LCDTerm::parse_escape() does
+ * it, so that a SOH in its parameters -- the fill character of ESC f,
+ * say -- is left for the terminal.
+ */
+bool AlertOverlay::take (Char c)
+  {
+  switch (state)
+    {
+    case ALERT_IDLE:
+#if LCDTERM_FEATURE_ESCAPES
+      if (c == 27)
+        {
+        state = ALERT_ESC_CMD;
+        return false;
+        }
+#endif
+      if (c != ALERT_START) return false;
+      state = ALERT_MODE;
+      break;
+#if LCDTERM_FEATURE_ESCAPES
+    case ALERT_ESC_CMD:
+      esc_left = LCDTerm::escape_param_count (c);
+      state = esc_left ? ALERT_ESC_PARAMS : ALERT_IDLE;
+      return false;
+    case ALERT_ESC_PARAMS:
+      // A string ends at any control character, which the terminal
+      //   takes as part of the sequence
+      if (esc_left == LCDTERM_ESC_STRING)
+        {
+        if (c < 32) state = ALERT_IDLE;
+        }
+      else if (--esc_left == 0)
+        state = ALERT_IDLE;
+      return false;
+#endif
+    case ALERT_MODE:
+      in_mode = c - 32;
+      state = ALERT_ROW;
+      break;
+    case ALERT_ROW:
+      in_row = c - 32;
+      state = ALERT_SECS;
+      break;
+    case ALERT_SECS:
+      in_secs = c - 32;
+      in_len = 0;
+      state = ALERT_TEXT;
+      break;
+    default:
+      if (c < 32)
+        {
+        state = ALERT_IDLE;
+        pending = true;
+        }
+      else if (in_len < ALERT_MAX)
+        in_text[in_len++] = c;
+    }
+  return true;
+  }
+
+/**
+ * apply
+ * A new alert replaces any that is showing. The terminal's screen is
+ * always right about what's under the alert, so what was kept from
+ * the last one is simply replaced. Cells that the old alert covered,
+ * but the new one doesn't, are put back.
+ */
+void AlertOverlay::apply (const Char *screen, unsigned long now)
+  {
+  pending = false;
+  uint8_t cols = cm.get_cols();
+  bool show = (in_mode & ALERT_MODE_SHOW) && in_row < cm.get_rows();
+
+  if (shown && (!show || in_row != row))
+    hide();
+  if (show)
+    {
+    uint8_t n = in_len < cols ? in_len : cols;
+    for (uint8_t i = 0; i < cols && i < ALERT_MAX; i++)
+      under[i] = screen[in_row * cols + i];
+    if (shown && len > n)
+      cm.write_run (row, n, under + n, len - n);
+    row = in_row;
+    len = n;
+    for (uint8_t i = 0; i < n; i++)
+      text[i] = in_text[i];
+    secs = in_secs;
+    shown_at = now;
+    shown = true;
+    cm.write_run (row, 0, text, len);
+    }
+
+  if (in_mode & ALERT_MODE_FLASH) bell();
+  }
+
+/**
+ * hide
+ */
+void AlertOverlay::hide (void)
+  {
+  if (!shown) return;
+  shown = false;
+  cm.write_run (row, 0, under, len);
+  }
+
+/**
+ * tick
+ * Taking down an alert moves the panel's cursor, and only the caller
+ * knows where it ought to be.
+ */
+bool AlertOverlay::tick (unsigned long now)
+  {
+  if (flashes && (now - flash_last) >= ALERT_FLASH_MSEC)
+    {
+    flashes--;
+    flash_last = now;
+    // With an even number of changes to go, the backlight goes back to
+    //   the way the terminal wants it
+    bool on = (flashes & 1) ? !backlight : backlight;
+    if (on)
+      cm.backlight_on();
+    else
+      cm.backlight_off();
+    }
+  if (shown && secs && (now - shown_at) >= secs * 1000UL)
+    {
+    hide();
+    return true;
+    }
+  return false;
+  }
+
+/**
+ * bell
+ * Start a visual bell: the backlight goes the other way straight away,
+ * and tick() takes care of the rest.
+ */
+void AlertOverlay::bell (void)
+  {
+  if (flashes) return;
+  flashes = ALERT_FLASHES * 2 - 1;
+  flash_last = millis();
+  if (backlight)
+    cm.backlight_off();
+  else
+    cm.backlight_on();
+  }
+
+/**
+ * backlight_on
+ * While a bell is flashing, the change waits until it's finished.
+ */
+void AlertOverlay::backlight_on (void)
+  {
+  backlight = true;
+  if (!flashes) cm.backlight_on();
+  }
+
+/**
+ * backlight_off
+ */
+void AlertOverlay::backlight_off (void)
+  {
+  backlight = false;
+  if (!flashes) cm.backlight_off();
+  }
+
+/**
+ * clear
+ * The alert stays on the screen.
+ */
+void AlertOverlay::clear (void)
+  {
+  cm.clear();
+  if (!shown) return;
+  for (uint8_t i = 0; i < len; i++)
+    under[i] = 0;
+  cm.write_run (row, 0, text, len);
+  }
+
+/**
+ * write_char_at
+ */
+void AlertOverlay::write_char_at (uint8_t r, uint8_t col, Char c)
+  {
+  if (shown && r == row && col < len)
+    under[col] = c;
+  else
+    cm.write_char_at (r, col, c);
+  }
+
+/**
+ * write_run
+ * The part of the run that falls under the alert is kept; the rest
+ * goes to the display.
+ */
+void AlertOverlay::write_run (uint8_t r, uint8_t col, const Char *s,
+    uint8_t n)
+  {
+  if (shown && r == row)
+    {
+    while (n && col < len)
+      {
+      under[col++] = *s++;
+      n--;
+      }
+    if (!n) return;
+    }
+  cm.write_run (r, col, s, n);
+  }
+
+/**
+ * write_rect
+ * The real matrix may be able to write a rectangle faster than one
+ * row at a time, so it gets the rectangle whole, unless the alert is
+ * in the way.
+ */
+void AlertOverlay::write_rect (uint8_t r, uint8_t col, uint8_t h,
+    uint8_t w, const Char *s, uint8_t stride)
+  {
+  if (shown && row >= r && row < r + h && col < len)
+    CharacterMatrix::write_rect (r, col, h, w, s, stride);
+  else
+    cm.write_rect (r, col, h, w, s, stride);
+  }
+
+/**
+ * write_offscreen_char
+ */
+void AlertOverlay::write_offscreen_char (uint8_t r, uint8_t col, Char c)
+  {
+  if (shown && r == row && col < len)
+    under[col] = c;
+  else
+    cm.write_offscreen_char (r, col, c);
+  }
+
+/**
+ * panel_reset
+ * The alert has gone from the panel, and has to be put back.
+ */
+void AlertOverlay::panel_reset (void)
+  {
+  cm.panel_reset();
+  if (shown) cm.write_run (row, 0, text, len);
+  }
+
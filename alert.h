@@ -0,0 +1,139 @@
+/*============================================================================
+
+  alert.h
+
+  A lane for urgent messages, that doesn't wait behind whatever
+  ordinary text is queued up. An alert is a packet in the input
+  stream:
+
+  SOH mode row seconds text terminator
+
+  SOH is 1. mode, row and seconds are sent as the value plus 32, like
+  the parameters of an escape sequence; the text is sent as itself,
+  and ends at the first control character, which is otherwise ignored.
+  mode is a combination of ALERT_MODE_SHOW (show the text on the given
+  row, over whatever is there) and ALERT_MODE_FLASH (flash the
+  backlight); zero takes down any alert that is showing. An alert that
+  is showing goes away after the given number of seconds, or stays
+  until the next one if seconds is zero.
+
+  The firmware picks alert packets out of the input as it reads it, so
+  they jump ahead of everything that is waiting to be parsed, and are
+  shown straight away. This means that SOH can't be used for anything
+  else, except in the parameters of an escape sequence: take() follows
+  escape sequences as LCDTerm does, and lets them through whole.
+
+  AlertOverlay sits between LCDTerm and the real CharacterMatrix, and
+  passes everything through, except writes to the cells that the alert
+  covers. Those are kept, so that when the alert goes, only the cells
+  it covered need to be written, not the whole screen.
+
+  bell() flashes the backlight, without waiting for the flashes to
+  finish; tick() has to be called often to carry them out.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "charactermatrix.h"
+
+#define ALERT_START 0x01
+
+#define ALERT_MODE_SHOW  0x01
+#define ALERT_MODE_FLASH 0x02
+
+// The longest alert text -- the width of the widest panel
+#define ALERT_MAX 40
+// Number of flashes for a bell, and the time the backlight spends on,
+//   or off, in each, msec
+#define ALERT_FLASHES 3
+#define ALERT_FLASH_MSEC 120
+
+class AlertOverlay : public CharacterMatrix
+  {
+  public:
+
+  AlertOverlay (CharacterMatrix &cm);
+
+  /** Offer a byte from the input. Returns true if it was part of an
+   *  alert packet, in which case it should go no further. Every byte
+   *  of the input must be offered, so that escape sequences can be
+   *  followed. */
+  bool take (Char c);
+
+  /** Returns true if a complete alert packet is waiting for apply(). */
+  bool ready (void) { return pending; }
+
+  /** Act on the alert packet that has arrived. screen is what the
+   *  terminal has on the display, row by row, as the starting point
+   *  for what's under the alert. The caller should put the cursor
+   *  back, and flush, afterwards. */
+  void apply (const Char *screen, unsigned long now);
+
+  /** Take down the alert, if one is showing, and put back what it
+   *  covered. */
+  void hide (void);
+
+  /** Carry out backlight flashes, and time alerts out. Call this
+   *  often, with the current time in msec. Returns true if an alert
+   *  was taken down, in which case the caller should put the cursor
+   *  back. */
+  bool tick (unsigned long now);
+
+  /* Start of methods implementing CharacterMatrix */
+  void init (void) { cm.init(); }
+  uint8_t get_rows (void) { return cm.get_rows(); }
+  uint8_t get_cols (void) { return cm.get_cols(); }
+  void write_char_at (uint8_t row, uint8_t col, Char c);
+  void set_cursor (uint8_t row, uint8_t col) { cm.set_cursor (row, col); }
+  void clear (void);
+  void backlight_on (void);
+  void backlight_off (void);
+  void cursor_on (void) { cm.cursor_on(); }
+  void cursor_off (void) { cm.cursor_off(); }
+  void bell (void);
+  void write_run (uint8_t row, uint8_t col, const Char *s, uint8_t n);
+  void write_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w,
+    const Char *s, uint8_t stride);
+  void flush (void) { cm.flush(); }
+  uint8_t get_shift_width (void) { return cm.get_shift_width(); }
+  void write_offscreen_char (uint8_t row, uint8_t col, Char c);
+  void shift_left (void) { cm.shift_left(); }
+  void shift_home (void) { cm.shift_home(); }
+  void define_char (uint8_t code, const uint8_t *bitmap)
+    { cm.define_char (code, bitmap); }
+  void panel_reset (void);
+  /* End of methods implementing CharacterMatrix */
+
+  protected:
+
+  CharacterMatrix &cm;
+
+  // The packet being received
+  uint8_t state;          // Where we are in the packet
+  uint8_t esc_left;       // Bytes of an escape sequence still to come,
+                          //   or LCDTERM_ESC_STRING
+  uint8_t in_mode, in_row, in_secs;
+  uint8_t in_len;
+  Char in_text[ALERT_MAX];
+  bool pending;           // A complete packet is waiting
+
+  // The alert that is showing
+  bool shown;
+  uint8_t row;
+  uint8_t len;            // Covers columns 0 to len-1
+  Char text[ALERT_MAX];
+  Char under[ALERT_MAX];  // What the terminal thinks is in those cells
+  uint16_t secs;          // Time to show it for; zero is forever
+  unsigned long shown_at;
+
+  // The backlight
+  bool backlight;         // As the terminal last set it
+  uint8_t flashes;        // Changes of backlight still to make
+  unsigned long flash_last;
+  };
+
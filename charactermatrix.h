@@ -8,8 +8,10 @@
   the HD44780 will implement this interface, so LCDTerm will be able
   to use the hardware in a terminal-like way.
 
-  This is an interface because all the methods are pure virtual. It
-  makes no sense to try to instantiate this class.
+  This is an interface because the essential methods are pure virtual. It
+  makes no sense to try to instantiate this class. A few optional
+  methods have default implementations, built on the essential ones,
+  which a class can override if the hardware can do better.
 
   Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
   GNU Public Licence, v3.0
@@ -18,6 +20,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint8_t Char;
@@ -69,6 +72,68 @@ class CharacterMatrix
 
   /** Sound a bell, or provide some other kind of alert, if possible. */
   virtual void bell (void) = 0;
+
+  /** Write n characters from s, starting at the specified position.
+   *  Like write_char_at, this must not wrap; characters that would
+   *  fall off the end of the row are discarded. */
+  virtual void write_run (uint8_t row, uint8_t col, const Char *s,
+      uint8_t n)
+    {
+    for (uint8_t i = 0; i < n; i++)
+      write_char_at (row, col + i, s[i]);
+    }
+
+  /** Write a rectangle of h rows by w characters, starting at the
+   *  specified position. Row r of the rectangle is taken from
+   *  s + r * stride. Hardware that can overlap the writes to different
+   *  rows may do better than one run at a time. */
+  virtual void write_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w,
+      const Char *s, uint8_t stride)
+    {
+    for (uint8_t r = 0; r < h; r++)
+      write_run (row + r, col, s + r * stride, w);
+    }
+
+  /** Send any output that the implementation has buffered. An
+   *  implementation that writes straight to the hardware need not
+   *  do anything. */
+  virtual void flush (void) {}
+
+  /** Return the number of cells in each row that a hardware display
+   *  shift cycles through, including those off the right-hand edge of
+   *  the display. Zero means that the hardware can't shift the display
+   *  -- or can, but not in a way that keeps each row to itself. */
+  virtual uint8_t get_shift_width (void) { return 0; }
+
+  /** Write a character to a cell that may be off the right-hand edge
+   *  of the display, but within get_shift_width(). Positions are as
+   *  they would be with no display shift. */
+  virtual void write_offscreen_char (uint8_t row, uint8_t col, Char c)
+    { (void)row; (void)col; (void)c; }
+
+  /** Shift the whole display one cell to the left, so that the cell
+   *  at the left-hand edge reappears on the far right of the row. */
+  virtual void shift_left (void) {}
+
+  /** Undo any display shift. */
+  virtual void shift_home (void) {}
+
+  /** Set the pattern for user-defined character code, 0-7, from
+   *  eight bytes, top row first, with the five pixels of each row in
+   *  the low bits. The cursor position afterwards is undefined. */
+  virtual void define_char (uint8_t code, const uint8_t *bitmap)
+    { (void)code; (void)bitmap; }
+
+  /** Return a copy of what the hardware shows, rows x cols characters,
+   *  row by row, or NULL if the implementation keeps none. */
+  virtual const Char *get_shown (void) { return NULL; }
+
+  /** Called when the hardware has been restarted behind the terminal's
+   *  back, and is now blank, with no user-defined characters. An
+   *  implementation that keeps a record of what the hardware shows, or
+   *  passes writes on to another CharacterMatrix, must bring itself up
+   *  to date, and pass this on. */
+  virtual void panel_reset (void) {}
   };
 
 
@@ -0,0 +1,294 @@
+/*==========================================================================
+
+    clock.cpp
+
+    Implementation of the class that is specified in clock.h.
+
+    The calendar arithmetic counts days from 1 March in year 0, which
+    puts the leap day at the end of the year, and makes the length of
+    each month up to the next February follow a simple pattern. See
+    Howard Hinnant's "chrono-Compatible Low-Level Date Algorithms".
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <stdint.h>
+#include <string.h>
+#include "platform.h"
+
+#include "clock.h"
+
+// Days from 1 March, year 0, to 1 January 2000
+#define CLOCK_EPOCH_DAYS 730425UL
+
+// The clock is moved on to a new base time every hour, so that the
+//   drift arithmetic fits in 32 bits, and millis() can wrap
+#define CLOCK_REBASE_MS 3600000UL
+
+// The host has to have set the time at least this far apart, seconds,
+//   for the error to say anything useful about the drift
+#define CLOCK_DRIFT_MIN_SECS 21600UL
+
+// The most drift that we'll believe; a ceramic resonator can be
+//   0.5% out
+#define CLOCK_PPM_MAX 10000
+
+// The longest that the drift is measured over, seconds. A host that
+//   sets the time less often than this gets no drift correction, but
+//   the arithmetic stays within 32 bits
+#define CLOCK_DRIFT_MAX_SECS (200UL * 86400UL)
+
+static const char day_names[] PROGMEM = "SunMonTueWedThuFriSat";
+static const char month_names[] PROGMEM =
+  "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+/**
+ * days_from_civil
+ * Returns days since 1 March, year 0.
+ */
+static uint32_t days_from_civil (uint16_t y, uint8_t m, uint8_t d)
+  {
+  if (m <= 2) y--;
+  uint8_t mp = (m + 9) % 12;
+  uint16_t doy = (153 * mp + 2) / 5 + d - 1;
+  return 365UL * y + y / 4 - y / 100 + y / 400 + doy;
+  }
+
+/**
+ * Clock constructor
+ */
+Clock::Clock (LCDTerm &term) :
+    term (term),
+    valid (false),
+    base_secs (0),
+    base_ms (0),
+    sync_secs (0),
+    drift_ms (0),
+    ppm (0)
+  {
+  memset (fields, 0, sizeof (fields));
+  }
+
+/**
+ * get
+ * Returns the time now, in seconds since 2000.
+ */
+uint32_t Clock::get (unsigned long now)
+  {
+  unsigned long elapsed = now - base_ms;
+  uint32_t ms = run_ms (now);
+  if (elapsed >= CLOCK_REBASE_MS)
+    {
+    base_secs += ms / 1000;
+    base_ms = now - ms % 1000;
+    return base_secs;
+    }
+  return base_secs + ms / 1000;
+  }
+
+/**
+ * run_ms
+ * Returns the msec that the clock has run since base_ms, corrected for
+ * the drift.
+ */
+uint32_t Clock::run_ms (unsigned long now)
+  {
+  unsigned long elapsed = now - base_ms;
+  // Correction in msec -- at most an hour's worth of seconds times
+  //   CLOCK_PPM_MAX, so no overflow
+  int32_t adj = (int32_t)(elapsed / 1000) * ppm / 1000;
+  return elapsed + adj;
+  }
+
+/**
+ * set
+ * The difference between the time the clock thinks it is and the time
+ * the host says it is, in msec, is added up over every set since the
+ * last measurement, sync_secs. Once that is long enough ago, the total
+ * goes into the drift correction, and the measurement starts again; a
+ * host that sets the time every few minutes gets its correction as
+ * surely as one that sets it twice a day. Adding up msec, rather than
+ * whole seconds, matters: the host only sends whole seconds, so each
+ * set leaves the clock up to a second behind, and the whole-second
+ * errors that follow would add up to drift that isn't there, where the
+ * msec errors cancel out. A total bigger than any drift we'd believe --
+ * a change to or from summer time, say, or a host that has put its own
+ * clock right -- is a step in the time, not drift. That only moves the
+ * clock, and starts the measurement again.
+ */
+bool Clock::set (const Char *s, uint8_t n, unsigned long now)
+  {
+  if (n != 14) return false;
+  uint8_t v[7]; // Century, year, month, day, hour, minute, second
+  for (uint8_t i = 0; i < 7; i++)
+    {
+    if (s[2 * i] < '0' || s[2 * i] > '9') return false;
+    if (s[2 * i + 1] < '0' || s[2 * i + 1] > '9') return false;
+    v[i] = (s[2 * i] - '0') * 10 + s[2 * i + 1] - '0';
+    }
+  uint16_t year = v[0] * 100 + v[1];
+  if (year < 2000 || v[2] < 1 || v[2] > 12 || v[3] < 1 || v[3] > 31
+      || v[4] > 23 || v[5] > 59 || v[6] > 59)
+    return false;
+
+  uint32_t days = days_from_civil (year, v[2], v[3]) - CLOCK_EPOCH_DAYS;
+  uint32_t t = days * 86400UL + v[4] * 3600UL + v[5] * 60U + v[6];
+
+  if (valid && t >= sync_secs && t - sync_secs <= CLOCK_DRIFT_MAX_SECS)
+    {
+    uint32_t interval = t - sync_secs;
+    // The most that CLOCK_PPM_MAX could account for, allowing a second
+    //   either way for the host only sending whole seconds
+    int32_t limit = interval / (1000000L / CLOCK_PPM_MAX) + 1;
+    int32_t err = (int32_t)(t - get (now));
+    if (err <= limit && err >= -limit)
+      {
+      // get() has just rebased the clock, if it needed to, so this is
+      //   at most an hour or so of msec
+      int32_t err_ms = (int32_t)(t - base_secs) * 1000L
+        - (int32_t)run_ms (now);
+      int32_t total = drift_ms + err_ms;
+      if (total <= limit * 1000L && total >= -limit * 1000L)
+        {
+        if (interval >= CLOCK_DRIFT_MIN_SECS)
+          {
+          // total * 10 can't overflow, given the limit, for any
+          //   interval up to CLOCK_DRIFT_MAX_SECS
+          int32_t p = ppm + total * 10L / (int32_t)(interval / 100);
+          if (p > CLOCK_PPM_MAX) p = CLOCK_PPM_MAX;
+          if (p < -CLOCK_PPM_MAX) p = -CLOCK_PPM_MAX;
+          ppm = p;
+          sync_secs = t;
+          drift_ms = 0;
+          }
+        else
+          drift_ms = total;
+        base_secs = t;
+        base_ms = now;
+        return true;
+        }
+      }
+    }
+
+  // The first set, or a step
+  base_secs = t;
+  base_ms = now;
+  sync_secs = t;
+  drift_ms = 0;
+  valid = true;
+  return true;
+  }
+
+/**
+ * set_field
+ */
+void Clock::set_field (uint8_t field, uint8_t row, uint8_t col,
+    uint8_t height, const Char *format, uint8_t n)
+  {
+  if (field >= CLOCK_FIELDS) return;
+  ClockField *f = &fields[field];
+  if (n > CLOCK_FORMAT_MAX) n = CLOCK_FORMAT_MAX;
+  f->row = row;
+  f->col = col;
+  f->height = height;
+  f->len = n;
+  memcpy (f->format, format, n);
+  }
+
+/**
+ * format
+ * Returns the number of characters written to out, which must have
+ * room for CLOCK_TEXT_MAX.
+ */
+uint8_t Clock::format (const ClockField *f, uint32_t t, Char *out)
+  {
+  uint32_t days = t / 86400UL;
+  uint32_t secs = t % 86400UL;
+  uint8_t hour = secs / 3600;
+  uint8_t min = (secs / 60) % 60;
+  uint8_t sec = secs % 60;
+  uint8_t wday = (days + 6) % 7; // 1 January 2000 was a Saturday
+
+  // From days since 1 March, year 0, to the date
+  uint32_t z = days + CLOCK_EPOCH_DAYS;
+  uint8_t era = z / 146097UL;
+  uint32_t doe = z - era * 146097UL;
+  uint16_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint16_t doy = doe - (365UL * yoe + yoe / 4 - yoe / 100);
+  uint8_t mp = (5 * doy + 2) / 153;
+  uint8_t mday = doy - (153 * mp + 2) / 5 + 1;
+  uint8_t mon = mp < 10 ? mp + 3 : mp - 9;
+  uint16_t year = era * 400 + yoe + (mon <= 2);
+
+  uint8_t len = 0;
+  for (uint8_t i = 0; i < f->len && len < CLOCK_TEXT_MAX - 4; i++)
+    {
+    Char c = f->format[i];
+    if (c != '%' || i + 1 >= f->len)
+      {
+      out[len++] = c;
+      continue;
+      }
+    uint16_t num;
+    uint8_t digits = 2;
+    const char *name = NULL;
+    switch (f->format[++i])
+      {
+      case 'H': num = hour; break;
+      case 'I': num = hour % 12 ? hour % 12 : 12; break;
+      case 'M': num = min; break;
+      case 'S': num = sec; break;
+      case 'd': num = mday; break;
+      case 'm': num = mon; break;
+      case 'y': num = year % 100; break;
+      case 'Y': num = year; digits = 4; break;
+      case 'a': name = day_names + wday * 3; break;
+      case 'b': name = month_names + (mon - 1) * 3; break;
+      case 'p':
+        out[len++] = hour < 12 ? 'A' : 'P';
+        out[len++] = 'M';
+        continue;
+      default:
+        out[len++] = f->format[i];
+        continue;
+      }
+    if (name)
+      {
+      for (uint8_t j = 0; j < 3; j++)
+        out[len++] = pgm_read_byte (name + j);
+      continue;
+      }
+    for (uint8_t j = digits; j > 0; j--)
+      {
+      out[len + j - 1] = '0' + num % 10;
+      num /= 10;
+      }
+    len += digits;
+    }
+  return len;
+  }
+
+/**
+ * tick
+ */
+void Clock::tick (unsigned long now)
+  {
+  if (!valid) return;
+  uint32_t t = get (now);
+  for (uint8_t i = 0; i < CLOCK_FIELDS; i++)
+    {
+    const ClockField *f = &fields[i];
+    if (!f->height) continue;
+    Char text[CLOCK_TEXT_MAX];
+    uint8_t n = format (f, t, text);
+#if LCDTERM_FEATURE_BIGDIGITS
+    if (f->height > 1)
+      {
+      term.big_text (f->row, f->col, f->height, text, n);
+      continue;
+      }
+#endif
+    term.put_text (f->row, f->col, text, n);
+    }
+  }
+
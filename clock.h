@@ -0,0 +1,98 @@
+/*============================================================================
+
+  clock.h
+
+  A clock that the firmware keeps for itself, so that a host that only
+  wants to show the time doesn't have to wake up every few seconds to
+  send it. The host sets the time once (ESC T), and says where, and in
+  what format, to show it (ESC k); after that, the clock redraws itself
+  each second, writing only the cells that change.
+
+  The time is kept as seconds since the start of 2000, local time --
+  whatever the host sends -- from millis(). The Pro Micro's clock is
+  only as good as its crystal or resonator, so each time the host sets
+  the time again, the error is used to work out how fast or slow
+  millis() runs, and the clock is corrected from then on. The error is
+  only worth measuring over a few hours, because the host only sends
+  whole seconds, so the errors from a host that sets the time more
+  often than that are added up until there are a few hours of them.
+
+  A format is text, as it is to be shown, with these fields:
+
+  %H hour, 00-23    %d day of the month, 01-31    %a day, Mon-Sun
+  %I hour, 01-12    %m month, 01-12               %b month, Jan-Dec
+  %M minute         %y year, 00-99                %p AM or PM
+  %S second         %Y year, 2000-                %% a % sign
+
+  A field with a height of 2 or 3 is drawn in big digits -- see
+  LCDTerm::big_text() -- so only the digits, spaces, and colons in it
+  will show.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "lcdterm.h"
+
+// Number of clock fields
+#define CLOCK_FIELDS 2
+// The longest format
+#define CLOCK_FORMAT_MAX 20
+// The widest that a field can be, once formatted
+#define CLOCK_TEXT_MAX 40
+
+typedef struct
+  {
+  uint8_t row, col;
+  uint8_t height;         // Zero if the field is not in use
+  uint8_t len;
+  Char format[CLOCK_FORMAT_MAX];
+  } ClockField;
+
+class Clock
+  {
+  public:
+
+  Clock (LCDTerm &term);
+
+  /** Set the time from the n characters of s, in the form
+   *  YYYYMMDDhhmmss, as the time at now (msec). Returns false, and
+   *  leaves the time alone, if it doesn't make sense. */
+  bool set (const Char *s, uint8_t n, unsigned long now);
+
+  /** Show field (0 to CLOCK_FIELDS - 1) at row, col, height rows high,
+   *  in the n-character format. A height of zero stops showing the
+   *  field, but leaves what was last shown on the screen. */
+  void set_field (uint8_t field, uint8_t row, uint8_t col, uint8_t height,
+    const Char *format, uint8_t n);
+
+  /** Bring the fields up to date, writing only the cells that have
+   *  changed. Call this often, with the current time in msec. It's
+   *  cheap when nothing has changed, so the fields are put back
+   *  promptly if the host clears the screen. */
+  void tick (unsigned long now);
+
+  /** Return the drift correction, in parts per million; positive if
+   *  millis() runs slow. */
+  int16_t get_ppm (void) { return ppm; }
+
+  protected:
+
+  LCDTerm &term;
+  bool valid;             // The time has been set
+  uint32_t base_secs;     // The time at base_ms
+  unsigned long base_ms;
+  uint32_t sync_secs;     // The time the drift is measured from
+  int32_t drift_ms;       // Error added up since sync_secs, msec
+  int16_t ppm;            // Correction to millis(), parts per million
+  ClockField fields[CLOCK_FIELDS];
+
+  uint32_t get (unsigned long now);
+  uint32_t run_ms (unsigned long now);
+  uint8_t format (const ClockField *f, uint32_t t, Char *out);
+  };
+
@@ -2,18 +2,29 @@
 
 # A simple script that uses the usb-lcd firmware to display the
 #  time and date. Note that the serial device might be /dev/ttyUSBxx
-#  on some systems. Note that updating once a minute means, of course,
-#  that the time could be wrong by up to one minute ;)
+#  on some systems. The firmware keeps the time itself, so this script
+#  only has to set it, and say where to show it: the time in big
+#  digits, two rows high, on the top two rows of a 20x4 panel, and the
+#  date on the bottom row. After that, it only sets the time again
+#  every six hours, so that the firmware can correct its clock for
+#  drift.
 
 DEVICE=/dev/ttyACM0
 
-# Turn off the cursor
-printf "\x13" > $DEVICE
+# Turn off the cursor, and clear the screen
+printf "\x13\f" > $DEVICE
+
+# ESC k field row col height format. Field 0 is the time, at row 0,
+#   column 2, two rows high; field 1 is the date, at row 3, column 0,
+#   one row high
+printf "\ek \x20\x22\x22%%H:%%M\r" > $DEVICE
+printf "\ek!\x23\x20\x21%%a %%b %%d %%Y\r" > $DEVICE
 
 while true ; do
-  DATE=`date "+%b %d %Y"`
-  TIME=`date "+%I:%M %p"`
-  printf "\f$DATE\r\n$TIME" > $DEVICE 
-  sleep 60
+  # Set the time just after the second changes, so the firmware's
+  #   seconds start when the host's do
+  S=`date +%S`
+  while [ `date +%S` == $S ] ; do sleep 0.05 ; done
+  printf "\eT$(date +%Y%m%d%H%M%S)\r" > $DEVICE
+  sleep 21600
 done
-
@@ -0,0 +1,30 @@
+/*============================================================================
+
+  font5x7.h
+
+  A copy of the printable ASCII part (32-126) of the HD44780's character
+  ROM -- the usual "A00" version, in which 92 is a yen sign, and 126 a
+  right arrow -- for drawing characters into the user-defined
+  characters, when the ROM's own won't do. LCDTerm uses it to make
+  inverted characters (see LCDTerm::set_attr()).
+
+  The font is kept in flash, five bytes a character, column by column,
+  with the top row in the least significant bit, which is how most
+  5x7 fonts are published.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "charactermatrix.h"
+
+/** Fill bitmap with the eight rows of c, as CharacterMatrix::define_char()
+ *  wants them -- five bits a row, the leftmost column in bit 4. The
+ *  eighth row, where the cursor goes, is empty. Returns false, and
+ *  leaves bitmap alone, if c is not in the font. */
+bool font5x7_glyph (Char c, uint8_t *bitmap);
+
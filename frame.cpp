@@ -0,0 +1,205 @@
+/*==========================================================================
+
+    frame.cpp
+
+    Implementation of the class that is specified in frame.h.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+
+/**
+ * FrameMatrix constructor
+ */
+FrameMatrix::FrameMatrix (CharacterMatrix &cm) :
+    cm (cm),
+    shown (NULL),
+    enabled (false),
+    held (false)
+  {
+  rows = cm.get_rows();
+  cols = cm.get_cols();
+  }
+
+/**
+ * FrameMatrix destructor
+ */
+FrameMatrix::~FrameMatrix()
+  {
+  free (shown);
+  }
+
+/**
+ * init
+ */
+void FrameMatrix::init (void)
+  {
+  if (!shown) shown = (Char *)malloc (rows * cols);
+  if (shown) memset (shown, 0, rows * cols);
+  cm.init();
+  }
+
+/**
+ * note
+ * Record that n characters have been written to the panel, starting at
+ * row, col. Anything off the edge is ignored, as the panel ignores it.
+ */
+void FrameMatrix::note (uint8_t row, uint8_t col, const Char *s, uint8_t n)
+  {
+  if (!shown || row >= rows || col >= cols) return;
+  if (n > cols - col) n = cols - col;
+  memcpy (shown + row * cols + col, s, n);
+  }
+
+/**
+ * commit
+ * Changed cells are written in runs, to save on address commands.
+ */
+void FrameMatrix::commit (const Char *screen, const uint8_t *skip)
+  {
+  held = false;
+  if (!shown)
+    {
+    cm.clear();
+    cm.write_rect (0, 0, rows, cols, screen, cols);
+    return;
+    }
+  for (uint8_t row = 0; row < rows; row++)
+    {
+    const Char *want = screen + row * cols;
+    const uint8_t *keep = skip ? skip + row * cols : NULL;
+    Char *have = shown + row * cols;
+    int16_t run_start = -1;
+    for (uint8_t col = 0; col <= cols; col++)
+      {
+      if (col < cols && have[col] != want[col] && !(keep && keep[col]))
+        {
+        have[col] = want[col];
+        if (run_start < 0) run_start = col;
+        }
+      else if (run_start >= 0)
+        {
+        cm.write_run (row, run_start, have + run_start, col - run_start);
+        run_start = -1;
+        }
+      }
+    }
+  }
+
+/**
+ * clear
+ * In frame mode, this starts a frame, and the display is left as it is.
+ * Only the display shift is undone, as a real clear would undo it.
+ */
+void FrameMatrix::clear (void)
+  {
+  if (enabled && shown)
+    {
+    held = true;
+    cm.shift_home();
+    return;
+    }
+  cm.clear();
+  if (shown) memset (shown, 0, rows * cols);
+  }
+
+/**
+ * write_char_at
+ */
+void FrameMatrix::write_char_at (uint8_t row, uint8_t col, Char c)
+  {
+  if (held) return;
+  note (row, col, &c, 1);
+  cm.write_char_at (row, col, c);
+  }
+
+/**
+ * set_cursor
+ * Moving the cursor around while a frame is built would only make it
+ * flicker. The caller puts it back once the frame is committed.
+ */
+void FrameMatrix::set_cursor (uint8_t row, uint8_t col)
+  {
+  if (!held) cm.set_cursor (row, col);
+  }
+
+/**
+ * write_run
+ * In frame mode, only the parts of the run that differ from what is
+ * showing are written, so that the terminal can repaint cells that may
+ * not have changed -- cells with attributes, after a commit -- without
+ * it costing anything if they haven't.
+ */
+void FrameMatrix::write_run (uint8_t row, uint8_t col, const Char *s,
+    uint8_t n)
+  {
+  if (held) return;
+  if (!enabled || !shown || row >= rows || col >= cols)
+    {
+    note (row, col, s, n);
+    cm.write_run (row, col, s, n);
+    return;
+    }
+  if (n > cols - col) n = cols - col;
+  Char *have = shown + row * cols + col;
+  int16_t run_start = -1;
+  for (uint8_t i = 0; i <= n; i++)
+    {
+    if (i < n && have[i] != s[i])
+      {
+      have[i] = s[i];
+      if (run_start < 0) run_start = i;
+      }
+    else if (run_start >= 0)
+      {
+      cm.write_run (row, col + run_start, s + run_start, i - run_start);
+      run_start = -1;
+      }
+    }
+  }
+
+/**
+ * write_rect
+ * The real matrix gets the rectangle whole, in case it can do better
+ * than one row at a time.
+ */
+void FrameMatrix::write_rect (uint8_t row, uint8_t col, uint8_t h,
+    uint8_t w, const Char *s, uint8_t stride)
+  {
+  if (held) return;
+  for (uint8_t r = 0; r < h; r++)
+    note (row + r, col, s + r * stride, w);
+  cm.write_rect (row, col, h, w, s, stride);
+  }
+
+/**
+ * write_offscreen_char
+ * The part of a row that is on the display is taken care of by
+ * commit(); the part beyond it can't be held back, because the
+ * terminal keeps no record of it.
+ */
+void FrameMatrix::write_offscreen_char (uint8_t row, uint8_t col, Char c)
+  {
+  if (col < cols)
+    {
+    if (held) return;
+    note (row, col, &c, 1);
+    }
+  cm.write_offscreen_char (row, col, c);
+  }
+
+/**
+ * panel_reset
+ * The panel is blank now, whatever the copy says.
+ */
+void FrameMatrix::panel_reset (void)
+  {
+  if (shown) memset (shown, 0, rows * cols);
+  cm.panel_reset();
+  }
+
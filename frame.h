@@ -0,0 +1,103 @@
+/*============================================================================
+
+  frame.h
+
+  Frame mode. Most programs that drive the panel send a form feed, and
+  then the whole screen, every few seconds, even when hardly anything
+  has changed. Without frame mode, the form feed clears the display --
+  which takes a couple of msec, and makes it flicker -- and every
+  character of the new screen is written again.
+
+  FrameMatrix sits between LCDTerm and the real CharacterMatrix, and
+  keeps a copy of what is on the panel. While frame mode is on, clear()
+  doesn't clear anything: it starts a frame, and everything written
+  after it is held back, the terminal's own screen buffer being the
+  only record of it. When the frame is committed, only the cells in
+  which the new screen differs from the copy are written. A frame that
+  is the same as the last one costs nothing at all. While frame mode is
+  on, the same goes for runs of characters written outside a frame:
+  cells that already show the right character are not written again.
+
+  FrameMatrix doesn't know when a frame ends -- that's up to the
+  caller, which should call commit() with the terminal's screen buffer
+  when the host says so, or when the input has been idle for a while,
+  and then put the cursor back.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "charactermatrix.h"
+
+class FrameMatrix : public CharacterMatrix
+  {
+  public:
+
+  FrameMatrix (CharacterMatrix &cm);
+  ~FrameMatrix();
+
+  /** Turn frame mode on or off. A frame that is open when frame mode
+   *  is turned off stays open until it is committed. */
+  void set_enabled (bool on) { enabled = on; }
+
+  /** Returns true if frame mode is on. */
+  bool is_enabled (void) { return enabled; }
+
+  /** Returns true if a frame has been started, and not committed. */
+  bool holding (void) { return held; }
+
+  /** Bring the panel into line with screen -- rows x cols characters,
+   *  row by row, as from LCDTerm::get_buff() -- writing only the
+   *  cells that differ, and end the frame. Cells for which skip, if
+   *  given, is nonzero are left alone: those are the cells with
+   *  attributes, as from LCDTerm::get_attrs(), which don't show what
+   *  is in the buffer, and which the terminal paints itself. The
+   *  cursor position is undefined afterwards. */
+  void commit (const Char *screen, const uint8_t *skip = NULL);
+
+  /** Return the copy of what is on the panel, rows x cols characters,
+   *  row by row. Empty cells are zero. */
+  const Char *get_shown (void) { return shown; }
+
+  /* Start of methods implementing CharacterMatrix */
+  void init (void);
+  uint8_t get_rows (void) { return rows; }
+  uint8_t get_cols (void) { return cols; }
+  void write_char_at (uint8_t row, uint8_t col, Char c);
+  void set_cursor (uint8_t row, uint8_t col);
+  void clear (void);
+  void backlight_on (void) { cm.backlight_on(); }
+  void backlight_off (void) { cm.backlight_off(); }
+  void cursor_on (void) { cm.cursor_on(); }
+  void cursor_off (void) { cm.cursor_off(); }
+  void bell (void) { cm.bell(); }
+  void write_run (uint8_t row, uint8_t col, const Char *s, uint8_t n);
+  void write_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w,
+    const Char *s, uint8_t stride);
+  void flush (void) { cm.flush(); }
+  uint8_t get_shift_width (void) { return cm.get_shift_width(); }
+  void write_offscreen_char (uint8_t row, uint8_t col, Char c);
+  void shift_left (void) { cm.shift_left(); }
+  void shift_home (void) { cm.shift_home(); }
+  void define_char (uint8_t code, const uint8_t *bitmap)
+    { cm.define_char (code, bitmap); }
+  void panel_reset (void);
+  /* End of methods implementing CharacterMatrix */
+
+  protected:
+
+  CharacterMatrix &cm;
+  uint8_t rows;
+  uint8_t cols;
+  Char *shown;            // What is on the panel, rows x cols
+  bool enabled;           // Frame mode is on
+  bool held;              // A frame is open
+
+  void note (uint8_t row, uint8_t col, const Char *s, uint8_t n);
+  };
+
@@ -0,0 +1,630 @@
+/*==========================================================================
+
+    hd44780.cpp
+
+    Implementation of the class that is specified in hd44780.h. This
+    file contains the parts of the HD44780 driver that do not depend on
+    how the controller is wired up: the initialization sequence, cursor
+    addressing, and the various display modes.
+
+    Datasheet for the HD44780:
+    https://www.sparkfun.com/datasheets/LCD/HD44780.pdf
+
+    Copyright (c)2020-2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <stdint.h>
+#include "platform.h"
+
+#include "hd44780.h"
+
+// HD44780 LCD module command set (see datasheet)
+#define LCD_CLEARDISPLAY 0x01
+#define LCD_RETURNHOME 0x02
+#define LCD_ENTRYMODESET 0x04
+#define LCD_DISPLAYCONTROL 0x08
+#define LCD_CURSORSHIFT 0x10
+#define LCD_FUNCTIONSET 0x20
+#define LCD_SETCGRAMADDR 0x40
+#define LCD_SETDDRAMADDR 0x80
+
+// HD44780 flags for text layout mode
+#define LCD_ENTRYRIGHT 0x00
+#define LCD_ENTRYLEFT 0x02
+#define LCD_ENTRYSHIFTINCREMENT 0x01
+#define LCD_ENTRYSHIFTDECREMENT 0x00
+
+// HD44780 flags for display mode (power, cursor, etc)
+#define LCD_DISPLAYON 0x04
+#define LCD_DISPLAYOFF 0x00
+#define LCD_CURSORON 0x02
+#define LCD_CURSOROFF 0x00
+#define LCD_BLINKON 0x01
+#define LCD_BLINKOFF 0x00
+
+// HD44780 flags for cursor and text scrolling
+#define LCD_DISPLAYMOVE 0x08
+#define LCD_CURSORMOVE 0x00
+#define LCD_MOVERIGHT 0x04
+#define LCD_MOVELEFT 0x00
+
+// HD44780 flags for hardware mode
+#define LCD_2LINE 0x08
+#define LCD_1LINE 0x00
+
+// Time after reset before the controller can be assumed to be awake,
+//  and the longest we'll wait for the bus hardware to respond, in msec
+#define LCD_POWERUP_MSEC 50
+#define LCD_READY_TIMEOUT_MSEC 500
+
+// Execution time of an ordinary command, in usec. The datasheet gives
+//  37 usec
+#define LCD_EXEC_USEC 40
+
+// The most cells that one controller can address
+#define LCD_CONTROLLER_CELLS 80
+
+
+/**
+ * HD44780 constructor
+ */
+HD44780::HD44780 (uint8_t _cols, uint8_t _rows, uint8_t _charsize,
+    uint8_t _bus_mode)
+  {
+  cols = _cols;
+  rows = _rows;
+  charsize = _charsize;
+  bus_mode = _bus_mode;
+  controllers = ((uint16_t)cols * rows > LCD_CONTROLLER_CELLS) ? 2 : 1;
+  controller = 0;
+  cursor_controller = 0;
+  exec_usec = LCD_EXEC_USEC;
+  bus_fault = 0;
+  bus_errors = 0;
+  recoveries = 0;
+  }
+
+/**
+ * init
+ */
+void HD44780::init()
+  {
+  hardware_mode = bus_mode | LCD_1LINE | LCD_5x8DOTS;
+  if (rows > 1)
+    {
+    hardware_mode |= LCD_2LINE;
+    }
+
+  // for some 1 line displays you can select a 10 pixel high font
+  if ((charsize != 0) && (rows == 1))
+    {
+    hardware_mode |= LCD_5x10DOTS;
+    }
+
+  // The controller needs 40 msec or so after power comes up before it
+  //  will accept anything. Rather than wait a fixed time every time we
+  //  start, we wait until that long after reset -- which has usually
+  //  passed already, if we came up through the bootloader -- and then
+  //  until the bus hardware answers.
+  while (millis() < LCD_POWERUP_MSEC);
+
+  // Now we pull both RS and R/W low to begin commands
+  bus_init();
+
+  unsigned long start = millis();
+  while (!bus_ready() && (millis() - start) < LCD_READY_TIMEOUT_MSEC);
+  // bus_init()'s first write may well have gone unanswered, if the
+  //   hardware was still coming up; that's no reason to send nothing
+  //   from now on
+  bus_fault = 0;
+
+  display_mode = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+  text_handling_mode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+  start_controllers();
+  }
+
+/**
+ * start_controllers
+ * The initialization sequence proper, which puts the controllers into
+ * the right bus mode whatever state they are in, and then sets the
+ * display and text handling modes from display_mode and
+ * text_handling_mode.
+ */
+void HD44780::start_controllers (void)
+  {
+  // Set into 4-bit mode
+  //  // Now... this is all a bit nasty...
+  // We need to set 4-bit mode, but the LCD module powers up in
+  //  eight bit mode. We can't be sure this is the first program
+  //  to use the LCD since power-up, so we don't know what
+  //  mode it's in. And we need to issue a command to set 4-bit
+  //  mode -- without knowing what mode we're in. So first we have
+  //  to enable 8-bit mode and then, knowing we're in 8-bit mode,
+  //  we must set 4-bit mode. Setting 8-bit mode without knowing the
+  //  current mode can be accomplished by sending the mode-setting
+  //  command as three identical 4-bit commands. If we start in
+  //  8-bit mode, some of these commands are gibberish 8-bit
+  //  commands with four of their bits set wrongly. But there's still
+  //  enough coherence for the module to get the message with thi
+  //  command sequence. This method of setting the mode is widely
+  //  used, even though it isn't documented, and it seems to work OK.
+  // In 8-bit mode the same sequence applies, except that we stop
+  //  once we know the module is in 8-bit mode.
+
+  // With two controllers, each step goes to both before the wait.
+
+  static const unsigned int waits[] = { 4500, 4500, 150 };
+  for (uint8_t i = 0; i < 3; i++)
+    {
+    for (controller = 0; controller < controllers; controller++)
+      write_bus (0x03 << 4, 0);
+    bus_wait (waits[i]);
+    }
+
+  if (bus_mode == LCD_4BITMODE)
+    {
+    for (controller = 0; controller < controllers; controller++)
+      write_bus (0x02 << 4, 0);
+    }
+
+  command_all (LCD_FUNCTIONSET | hardware_mode);
+  update_display_mode();
+  command_all (LCD_ENTRYMODESET | text_handling_mode);
+  }
+
+/**
+ * recover
+ * A glitch on the bus can leave the controller half-way through a
+ * nibble pair, or back in 8-bit mode, and from then on everything it
+ * gets is garbage. There's no way to find out what state it's in, so
+ * the only cure is to start it again from scratch. There's no need to
+ * wait for power-up this time, so this takes only the ten msec or so
+ * of the initialization sequence, and the clear.
+ */
+uint8_t HD44780::recover (void)
+  {
+  // The bus is reset first, because it might be our end that is stuck,
+  //   in which case nothing will answer until it has been
+  bus_reset();
+  if (!bus_ready()) return 0;
+  bus_fault = 0;
+  start_controllers();
+  clear();
+  if (bus_fault) return 0;
+  recoveries++;
+  return 1;
+  }
+
+/**
+ * bus_reset
+ * By default, resetting the bus is the same as setting it up in the
+ * first place.
+ */
+void HD44780::bus_reset (void)
+  {
+  bus_init();
+  }
+
+/**
+ * note_bus_error
+ */
+void HD44780::note_bus_error (void)
+  {
+  bus_fault = 1;
+  bus_errors++;
+  }
+
+/**
+ * clear
+ * Note that the hardware implicitly resets the cursor, so we must reflect
+ * that in the saved position
+ */
+void HD44780::clear()
+  {
+  command_all (LCD_CLEARDISPLAY);
+  bus_wait (2000);
+  }
+
+/**
+ * set_cursor
+ * With two controllers, only the one that holds the cursor's row may
+ * show a cursor, so moving it from one to the other means telling
+ * both.
+ */
+void HD44780::set_cursor (uint8_t row, uint8_t col)
+  {
+  if (row >= rows) return;
+  uint8_t which = (controllers > 1) ? row >> 1 : 0;
+  if (which != cursor_controller)
+    {
+    cursor_controller = which;
+    if (display_mode & (LCD_CURSORON | LCD_BLINKON))
+      update_display_mode();
+    }
+  set_address (row, col);
+  }
+
+/**
+ * display_off
+ */
+void HD44780::display_off (void)
+  {
+  display_mode &= ~LCD_DISPLAYON;
+  update_display_mode();
+  }
+
+/**
+ * display_on
+ */
+void HD44780::display_on (void)
+  {
+  display_mode |= LCD_DISPLAYON;
+  update_display_mode();
+  }
+
+/**
+ * cursor_off
+ */
+void HD44780::cursor_off (void)
+  {
+  display_mode &= ~LCD_CURSORON;
+  update_display_mode();
+  }
+
+/**
+ * cursor_on
+ */
+void HD44780::cursor_on (void)
+  {
+  display_mode |= LCD_CURSORON;
+  update_display_mode();
+  }
+
+/**
+ * blink off
+ */
+void HD44780::blink_off (void)
+  {
+  display_mode &= ~LCD_BLINKON;
+  update_display_mode();
+  }
+
+/**
+ * blink on
+ */
+void HD44780::blink_on (void)
+  {
+  display_mode |= LCD_BLINKON;
+  update_display_mode();
+  }
+
+/**
+ * scroll_left
+ */
+void HD44780::scroll_left (void)
+  {
+  command_all (LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
+  }
+
+/**
+ * scroll_right
+ */
+void HD44780::scroll_right (void)
+  {
+  command_all (LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVERIGHT);
+  }
+
+/**
+ * left_to_right
+ */
+void HD44780::left_to_right (void)
+  {
+  text_handling_mode |= LCD_ENTRYLEFT;
+  command_all (LCD_ENTRYMODESET | text_handling_mode);
+  }
+
+/**
+ * right_to_left
+ */
+void HD44780::right_to_left (void)
+  {
+  text_handling_mode &= ~LCD_ENTRYLEFT;
+  command_all (LCD_ENTRYMODESET | text_handling_mode);
+  }
+
+/**
+ * autoscroll_on
+ */
+void HD44780::autoscroll_on (void)
+  {
+  text_handling_mode |= LCD_ENTRYSHIFTINCREMENT;
+  command_all (LCD_ENTRYMODESET | text_handling_mode);
+  }
+
+/**
+ * autoscroll_off
+ */
+void HD44780::autoscroll_off (void)
+  {
+  text_handling_mode &= ~LCD_ENTRYSHIFTINCREMENT;
+  command_all (LCD_ENTRYMODESET | text_handling_mode);
+  }
+
+/**
+ * backlight_off
+ */
+void HD44780::backlight_off (void)
+  {
+  set_backlight (0);
+  }
+
+/**
+ * backlight_on
+ */
+void HD44780::backlight_on (void)
+  {
+  set_backlight (1);
+  }
+
+/**
+ * write_char_at
+ */
+void HD44780::write_char_at (uint8_t row, uint8_t col, Char c)
+  {
+  if (c == 0) c = 32; // Make null into space
+  if (row < rows && col < cols)
+    {
+    set_address (row, col);
+    send_byte (c, 1);
+    }
+  }
+
+/**
+ * write_run
+ * The controller advances its address after each character, so a run
+ * needs only one address command, rather than one per character.
+ */
+void HD44780::write_run (uint8_t row, uint8_t col, const Char *s, uint8_t n)
+  {
+  if (row >= rows || col >= cols) return;
+  if (n > cols - col) n = cols - col;
+  set_address (row, col);
+  for (uint8_t i = 0; i < n; i++)
+    {
+    Char c = s[i];
+    if (c == 0) c = 32; // Make null into space
+    send_byte (c, 1);
+    }
+  }
+
+/**
+ * write_rect
+ * With two controllers, a row from the top half is paired with one
+ * from the bottom half, and the bytes for the two are sent turn and
+ * turn about. Each controller then executes one byte while the other
+ * is being sent the next, so each strobe need only be followed by half
+ * the usual wait.
+ */
+void HD44780::write_rect (uint8_t row, uint8_t col, uint8_t h,
+    uint8_t w, const Char *s, uint8_t stride)
+  {
+  if (row >= rows || col >= cols) return;
+  if (h > rows - row) h = rows - row;
+  if (w > cols - col) w = cols - col;
+
+  // Rows row..split-1 are on the first controller, the rest on the
+  //  second
+  uint8_t split = row < 2 ? 2 : row;
+  if (controllers == 1 || split >= row + h || split == row)
+    {
+    CharacterMatrix::write_rect (row, col, h, w, s, stride);
+    return;
+    }
+
+  uint8_t top = row, bottom = split;
+  exec_usec = LCD_EXEC_USEC / 2;
+  while (top < split && bottom < row + h)
+    {
+    const Char *s0 = s + (top - row) * stride;
+    const Char *s1 = s + (bottom - row) * stride;
+    set_address (top, col);
+    set_address (bottom, col);
+    for (uint8_t i = 0; i < w; i++)
+      {
+      controller = 0;
+      send_byte (s0[i] ? s0[i] : 32, 1);
+      controller = 1;
+      send_byte (s1[i] ? s1[i] : 32, 1);
+      }
+    top++;
+    bottom++;
+    }
+  exec_usec = LCD_EXEC_USEC;
+
+  // Whatever didn't have a partner
+  for (; top < split; top++)
+    write_run (top, col, s + (top - row) * stride, w);
+  for (; bottom < row + h; bottom++)
+    write_run (bottom, col, s + (bottom - row) * stride, w);
+  }
+
+/**
+ * get_shift_width
+ * In two-line mode, each row has its own 40-cell line of DDRAM, and the
+ * display shift rotates each line separately. A one-line display has a
+ * single 80-cell line. Four-row panels with one controller are really
+ * two lines, each folded across two rows, so shifting the display moves
+ * text from one row onto another -- no use for our purposes. With two
+ * controllers, each row has a line of its own again.
+ */
+uint8_t HD44780::get_shift_width (void)
+  {
+  if (rows == 1) return 80;
+  if (rows == 2 || controllers > 1) return 40;
+  return 0;
+  }
+
+/**
+ * write_offscreen_char
+ */
+void HD44780::write_offscreen_char (uint8_t row, uint8_t col, Char c)
+  {
+  if (c == 0) c = 32; // Make null into space
+  if (row < rows && col < get_shift_width())
+    {
+    set_address (row, col);
+    send_byte (c, 1);
+    }
+  }
+
+/**
+ * shift_left
+ */
+void HD44780::shift_left (void)
+  {
+  scroll_left();
+  }
+
+/**
+ * shift_home
+ * Return-home undoes the shift, and is one of the slow commands.
+ */
+void HD44780::shift_home (void)
+  {
+  command_all (LCD_RETURNHOME);
+  bus_wait (2000);
+  }
+
+/**
+ * define_char
+ * Each character has eight bytes of CGRAM. Codes 8-15 show the same
+ * characters as 0-7, which is handy, since code 0 can't be sent as
+ * part of a string. With two controllers, both get the pattern.
+ */
+void HD44780::define_char (uint8_t code, const uint8_t *bitmap)
+  {
+  for (controller = 0; controller < controllers; controller++)
+    {
+    command (LCD_SETCGRAMADDR | ((code & 7) << 3));
+    for (uint8_t i = 0; i < 8; i++)
+      send_byte (bitmap[i], 1);
+    }
+  controller = 0;
+  }
+
+/** get_rows */
+uint8_t HD44780::get_rows (void)
+  {
+  return rows;
+  }
+
+/** get_cols */
+uint8_t HD44780::get_cols (void)
+  {
+  return cols;
+  }
+
+
+/* =========================================================================
+       protected functions below this point
+=========================================================================*/
+
+/**
+ * bus_ready
+ * Unless a subclass knows better, the bus is always ready.
+ */
+uint8_t HD44780::bus_ready (void)
+  {
+  return 1;
+  }
+
+/**
+ * bus_wait
+ * Wait for the controller to finish a slow operation (clear, or a step
+ * of the initialization sequence). A subclass that buffers its output
+ * must send it before waiting, else the wait achieves nothing.
+ */
+void HD44780::bus_wait (unsigned int us)
+  {
+  delayMicroseconds (us);
+  }
+
+/**
+ * command
+ * Send a command to the display. That is, sent a byte, with the
+ * cmd/data pin set low
+ */
+void HD44780::command (uint8_t value)
+  {
+  send_byte (value, 0);
+  }
+
+/**
+ * command_all
+ * Send a command to every controller. Commands that change the whole
+ * display -- clear, shift, modes -- have to go to both halves of a
+ * 40x4 panel.
+ */
+void HD44780::command_all (uint8_t value)
+  {
+  for (controller = 0; controller < controllers; controller++)
+    command (value);
+  controller = 0;
+  }
+
+/**
+ * set_address
+ * Select the controller for row, and set its DDRAM address. Rows 0 and
+ * 1 start at 0x00 and 0x40. On a four-row panel with one controller,
+ * rows 2 and 3 are the continuation of rows 0 and 1, so they start
+ * one panel width further on -- 0x14 and 0x54 on a 20x4, but 0x10 and
+ * 0x50 on a 16x4. With two controllers, rows 2 and 3 are rows 0 and 1
+ * of the second one.
+ */
+void HD44780::set_address (uint8_t row, uint8_t col)
+  {
+  uint8_t addr = col;
+  if (row & 1) addr += 0x40;
+  if (controllers > 1)
+    controller = row >> 1;
+  else if (row & 2)
+    addr += cols;
+  command (LCD_SETDDRAMADDR | addr);
+  }
+
+/**
+ * update_display_mode
+ * Send the display on/off, cursor and blink settings. Only the
+ * controller that holds the cursor gets to show it.
+ */
+void HD44780::update_display_mode (void)
+  {
+  for (controller = 0; controller < controllers; controller++)
+    {
+    uint8_t mode = display_mode;
+    if (controller != cursor_controller)
+      mode &= ~(LCD_CURSORON | LCD_BLINKON);
+    command (LCD_DISPLAYCONTROL | mode);
+    }
+  controller = 0;
+  }
+
+/**
+ * send_byte
+ * Send a byte, with the cmd/data mode pin set as specific. This should
+ * be zero for commands, and one for data. In 4-bit mode the byte goes
+ * as two four-bit blocks, high bits first.
+ */
+void HD44780::send_byte (uint8_t value, uint8_t data_mode)
+  {
+  if (bus_mode == LCD_8BITMODE)
+    {
+    write_bus (value, data_mode);
+    }
+  else
+    {
+    write_bus (value & 0xf0, data_mode);
+    write_bus ((value << 4) & 0xf0, data_mode);
+    }
+  }
+
@@ -0,0 +1,211 @@
+/*============================================================================
+
+  hd44780.h
+
+  The command logic for an HD44780 LCD controller, independent of how
+  the controller is wired up. This class implements the CharacterMatrix
+  interface, but leaves the actual transfer of data to the controller's
+  pins to a subclass. LCD8574Arduino does this through a PCF8574 I2C
+  expander; LCDParallel does it by writing directly to the AVR's port
+  registers.
+
+  A subclass must implement bus_init(), write_bus(), and set_backlight().
+  Everything else -- the initialization sequence, cursor addressing,
+  display modes -- is handled here. A subclass that can tell when a
+  write has failed should call note_bus_error(), so that the caller can
+  find out, and call recover().
+
+  One HD44780 can address only 80 cells, so a 40x4 panel has two of
+  them, sharing every line except E. The top two rows belong to the
+  first controller and the bottom two to the second, each addressed as
+  a 40x2 panel. Panels with more than 80 cells are taken to be wired
+  this way; the subclass is told which controller to strobe by the
+  controller member, and must drive a second enable line for it.
+
+  Copyright (c)1990-2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "charactermatrix.h"
+
+// Constant for pixel size, used by the constructor. In practive,
+//  only 5x8 seems to be used, and I think the 5x10 is only available
+//  in single-line displays
+#define LCD_5x10DOTS 0x04
+#define LCD_5x8DOTS 0x00
+
+// Bus width, passed to the constructor by subclasses that can drive
+//  all eight data lines
+#define LCD_8BITMODE 0x10
+#define LCD_4BITMODE 0x00
+
+class HD44780 : public CharacterMatrix
+{
+public:
+  /** HD44780 constructor -- specify the size of the panel, and the
+      width of the data bus that the subclass drives. */
+  HD44780 (uint8_t lcdcols, uint8_t lcdrows, uint8_t charsize = LCD_5x8DOTS,
+    uint8_t bus_mode = LCD_4BITMODE);
+
+  /* Start of methods implementing CharacterMatrix */
+
+  /** Initialze the display hardware. Call this after the constructor.
+   *  In principle this method can fail, but we
+   *  have no real way to find out if it does.
+   */
+  void init();
+
+  /** Turn the LCD backlight on. */
+  void backlight_on (void);
+
+  /** Turn the LCD backlight off. */
+  void backlight_off (void);
+
+  /** Clear the screen, and implicitly home the cursor. */
+  void clear();
+
+  /** Show the cursor. */
+  void cursor_on (void);
+
+  /** Hide the cursor. */
+  void cursor_off (void);
+
+  /** Ring bell. */
+  void bell (void) {}; // Not implemented
+
+  /** Set the cursor position (zero-based). */
+  void set_cursor (uint8_t row, uint8_t col);
+
+  /** Write a character at the specific location. */
+  void write_char_at (uint8_t row, uint8_t col, Char c);
+
+  /** Write a run of characters, starting at the specified location. */
+  void write_run (uint8_t row, uint8_t col, const Char *s, uint8_t n);
+
+  /** Write a rectangle of characters, interleaving the two controllers
+   *  of a 40x4 panel. */
+  void write_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w,
+    const Char *s, uint8_t stride);
+
+  /** Get the length of a DDRAM line, if the hardware shift keeps each
+   *  row separate. */
+  uint8_t get_shift_width (void);
+
+  /** Write a character anywhere in a row's DDRAM line. */
+  void write_offscreen_char (uint8_t row, uint8_t col, Char c);
+
+  /** Shift the display one cell left. */
+  void shift_left (void);
+
+  /** Undo any display shift. */
+  void shift_home (void);
+
+  /** Set the pattern for a user-defined character. */
+  void define_char (uint8_t code, const uint8_t *bitmap);
+
+  /** Get number of rows, as passed to the constructor. */
+  uint8_t get_rows (void);
+
+  /** Get number of columns, as passed to the constructor. */
+  uint8_t get_cols (void);
+
+  /* End of methods implementing CharacterMatrix */
+
+  /** Returns true if the subclass has reported a failed write since
+   *  the last recover(). The panel may be showing garbage. */
+  uint8_t bus_failed (void) { return bus_fault; }
+
+  /** Reset the bus, and put the controllers back into a known state,
+   *  as init() does, but without waiting for power-up. The display is
+   *  left blank, with the cursor and the display modes as they were;
+   *  putting the text back is up to the caller. Returns false if the
+   *  bus is still not answering, or failed again. */
+  uint8_t recover (void);
+
+  /** Get the number of writes that have failed. */
+  uint16_t get_bus_errors (void) { return bus_errors; }
+
+  /** Get the number of successful calls to recover(). */
+  uint16_t get_recoveries (void) { return recoveries; }
+
+  /** Turn the display off. */
+  void display_off (void);
+
+  /** Turn the display on. */
+  void display_on (void);
+
+  /** Set the cursor to blink. */
+  void blink_on (void);
+
+  /** Set the cursor not to blink. */
+  void blink_off (void);
+
+  /** Use the LCD panel's logic to scroll the whole display left. */
+  void scroll_left();
+
+  /** Use the LCD panel's logic to scroll the whole display right. */
+  void scroll_right();
+
+  /** Enable left-to-right text layout (default). */
+  void left_to_right (void);
+
+  /** Enable right-to-left text layout (default). */
+  void right_to_left (void);
+
+  /** Enable the LCD display's built-in text scrolling. */
+  void autoscroll_on (void);
+
+  /** Disable the LCD display's built-in text scrolling. */
+  void autoscroll_off (void);
+
+protected:
+  /** Prepare the bus (I2C, port registers, etc) for use, and leave all
+   *  the control lines low. Called once, at the start of init(). */
+  virtual void bus_init (void) = 0;
+
+  /** Present value to the controller's data lines and strobe the
+   *  enable line of the controller selected by the controller member.
+   *  In 4-bit mode only the top four bits of value are used, and they
+   *  go to D4-D7. data_mode is one for data, zero for commands. The
+   *  implementation must wait exec_usec after the strobe, which is
+   *  long enough for an ordinary command to complete -- or, when the
+   *  writes are alternating between two controllers, for half of
+   *  one. */
+  virtual void write_bus (uint8_t value, uint8_t data_mode) = 0;
+
+  /** Drive the backlight, if the wiring allows it. Called with the
+   *  control lines idle. */
+  virtual void set_backlight (uint8_t on) = 0;
+
+  /* Note that other protected methods are documented in the .cpp file */
+  virtual uint8_t bus_ready (void);
+  virtual void bus_wait (unsigned int us);
+  virtual void bus_reset (void);
+  void note_bus_error (void);
+  void start_controllers (void);
+  void send_byte (uint8_t, uint8_t);
+  void command (uint8_t);
+  void command_all (uint8_t);
+  void set_address (uint8_t row, uint8_t col);
+  void update_display_mode (void);
+
+  uint8_t charsize; // As set in the constructor
+  uint8_t bus_mode; // LCD_4BITMODE or LCD_8BITMODE
+  uint8_t hardware_mode; // Lines, pixel size, etc
+  uint8_t display_mode; // Power, cursor, blink, etc
+  uint8_t text_handling_mode; // Direction, scrolling, etc
+  uint8_t cols;
+  uint8_t rows;
+  uint8_t controllers; // One, or two for a 40x4 panel
+  uint8_t controller; // The one that write_bus() should strobe
+  uint8_t cursor_controller; // The one that is showing the cursor
+  uint8_t exec_usec; // Time to wait after each strobe
+  uint8_t bus_fault; // A write has failed since the last recover()
+  uint16_t bus_errors; // Number of failed writes
+  uint16_t recoveries; // Number of successful recover()s
+};
+
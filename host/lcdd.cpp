@@ -0,0 +1,477 @@
+/**
+
+lcdd
+
+A host daemon that owns the board's serial device, and lets any number
+of programs share the panel. Each program connects to a Unix socket,
+and gets a rectangular window of the panel to itself. The daemon keeps
+a model of the whole screen, put together from the windows, and sends
+the board only the cells that have changed since the last update --
+by way of the ESC Y cursor-addressing sequence -- at most once every
+update interval.
+
+Usage: lcdd [-d device] [-s socket] [-r rows] [-c cols] [-i msec]
+
+A client starts by sending one line that gives its window's position
+and size, as four decimal numbers:
+
+  top left height width
+
+and anything it sends after that is displayed in the window. Each
+window has its own LCDTerm, so text wraps and scrolls inside the
+window, form feed clears only the window, and so on, just as if the
+window were a small panel of its own. Escapes that would affect the
+whole board -- the backlight, saving the screen -- are ignored.
+Where windows overlap, the one that connected last is on top.
+
+When a client disconnects, what it displayed stays on the panel until
+another client opens a window that overlaps it. So a script that only
+updates the panel now and then can connect, send one update, and go:
+
+  printf "0 0 2 20\n\f$DATE\n$TIME" | nc -U /tmp/lcdd.sock
+
+The board must have been built with the screen-editing escapes
+(LCDTERM_FEATURE_REGIONS), which all but the minimal profile have.
+
+The device doesn't have to be a real board: a pty, or a plain file,
+will do, and what lcdd writes can be fed to lcdemu to see the result.
+
+Copyright (c)2021 Kevin Boone
+Distributed according to the terms of the GPL, v3.0
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lcdterm.h"
+
+#define MAX_CLIENTS 16
+// Longest window specification line
+#define HEADER_MAX 40
+// Changed cells this close together in a row are sent as one run,
+//   unchanged cells and all, since that's no more bytes than an ESC Y
+#define RUN_GAP 4
+
+/**
+ * WindowMatrix
+ * A CharacterMatrix with no hardware at all. LCDTerm keeps its own
+ * copy of what's on the screen, which is all that the daemon needs.
+ */
+class WindowMatrix final : public CharacterMatrix
+  {
+  public:
+  WindowMatrix (uint8_t _rows, uint8_t _cols) : rows (_rows), cols (_cols) {}
+  void init (void) {}
+  uint8_t get_rows (void) { return rows; }
+  uint8_t get_cols (void) { return cols; }
+  void write_char_at (uint8_t row, uint8_t col, Char c)
+    { (void)row; (void)col; (void)c; }
+  void set_cursor (uint8_t row, uint8_t col) { (void)row; (void)col; }
+  void clear (void) {}
+  void backlight_on (void) {}
+  void backlight_off (void) {}
+  void cursor_on (void) {}
+  void cursor_off (void) {}
+  void bell (void) {}
+
+  protected:
+  uint8_t rows;
+  uint8_t cols;
+  };
+
+typedef struct
+  {
+  int fd;             // -1 once the client has gone
+  int doomed;         // Window to be removed
+  int top, left;
+  WindowMatrix *cm;   // NULL until the window has been specified
+  LCDTerm *term;
+  char header[HEADER_MAX];
+  int header_len;
+  } Client;
+
+static Client clients[MAX_CLIENTS];
+static int nclients;
+static int rows = 4;
+static int cols = 20;
+static Char *sent;     // What the panel is showing
+static Char *screen;   // What it should be showing
+static int dirty;
+
+/**
+ * open_device
+ * Open the board's serial device, and put it into raw mode if it's a
+ * terminal.
+ */
+static int open_device (const char *device)
+  {
+  int fd = open (device, O_WRONLY | O_NOCTTY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+    {
+    perror (device);
+    return -1;
+    }
+  struct termios t;
+  if (tcgetattr (fd, &t) == 0)
+    {
+    cfmakeraw (&t);
+    tcsetattr (fd, TCSANOW, &t);
+    }
+  return fd;
+  }
+
+/**
+ * open_socket
+ */
+static int open_socket (const char *path)
+  {
+  struct sockaddr_un addr;
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen (path) >= sizeof (addr.sun_path))
+    {
+    fprintf (stderr, "%s: socket path too long\n", path);
+    return -1;
+    }
+  strcpy (addr.sun_path, path);
+
+  int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    {
+    perror ("socket");
+    return -1;
+    }
+  unlink (path);
+  if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0
+      || listen (fd, 4) < 0)
+    {
+    perror (path);
+    close (fd);
+    return -1;
+    }
+  return fd;
+  }
+
+/**
+ * write_all
+ */
+static int write_all (int fd, const Char *buf, size_t n)
+  {
+  while (n > 0)
+    {
+    ssize_t w = write (fd, buf, n);
+    if (w < 0)
+      {
+      if (errno == EINTR) continue;
+      return -1;
+      }
+    buf += w;
+    n -= w;
+    }
+  return 0;
+  }
+
+/**
+ * now_msec
+ */
+static unsigned long now_msec (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+  }
+
+/**
+ * compose
+ * Build the screen model from the windows, bottom one first.
+ */
+static void compose (void)
+  {
+  memset (screen, 0, rows * cols);
+  for (int i = 0; i < nclients; i++)
+    {
+    Client *c = &clients[i];
+    if (!c->term) continue;
+    int h = c->term->get_rows(), w = c->term->get_cols();
+    const Char *buff = c->term->get_buff();
+    for (int r = 0; r < h; r++)
+      memcpy (screen + (c->top + r) * cols + c->left, buff + r * w, w);
+    }
+  }
+
+/**
+ * update
+ * Send the board the cells that differ between the model and what it
+ * is showing. Each run of changes costs four bytes for the ESC Y, plus
+ * one per cell.
+ */
+static int update (int dev)
+  {
+  Char out[4096];
+  size_t n = 0;
+
+  compose();
+  for (int r = 0; r < rows; r++)
+    {
+    Char *want = screen + r * cols;
+    Char *have = sent + r * cols;
+    int c = 0;
+    while (c < cols)
+      {
+      if (want[c] == have[c])
+        {
+        c++;
+        continue;
+        }
+      // Extend the run as long as the next change is close enough
+      int start = c, end = c + 1, gap = 0;
+      for (int i = c + 1; i < cols && gap < RUN_GAP; i++)
+        {
+        if (want[i] != have[i])
+          {
+          end = i + 1;
+          gap = 0;
+          }
+        else
+          gap++;
+        }
+      out[n++] = 27;
+      out[n++] = 'Y';
+      out[n++] = r + 32;
+      out[n++] = start + 32;
+      for (int i = start; i < end; i++)
+        {
+        // Nulls are blank cells; anything else below 32 would be taken
+        //   as a control code
+        Char ch = want[i] < 32 ? ' ' : want[i];
+        out[n++] = ch;
+        have[i] = want[i];
+        }
+      c = end;
+      }
+    }
+
+  dirty = 0;
+  if (n == 0) return 0;
+  return write_all (dev, out, n);
+  }
+
+/**
+ * remove_client
+ */
+static void remove_client (int i)
+  {
+  Client *c = &clients[i];
+  if (c->fd >= 0) close (c->fd);
+  delete c->term;
+  delete c->cm;
+  memmove (clients + i, clients + i + 1,
+    (nclients - i - 1) * sizeof (Client));
+  nclients--;
+  dirty = 1;
+  }
+
+/**
+ * disconnect_client
+ * The client has gone; keep its window, if it had one.
+ */
+static void disconnect_client (Client *c)
+  {
+  close (c->fd);
+  c->fd = -1;
+  if (!c->term) c->doomed = 1;
+  }
+
+/**
+ * remove_doomed
+ */
+static void remove_doomed (void)
+  {
+  for (int i = nclients - 1; i >= 0; i--)
+    if (clients[i].doomed) remove_client (i);
+  }
+
+/**
+ * start_window
+ * Parse the window specification, and create the window's terminal.
+ * Windows left behind by clients that have gone are removed, if the
+ * new window overlaps them. Returns 0 if the specification is no good.
+ */
+static int start_window (Client *c)
+  {
+  int top, left, h, w;
+  if (sscanf (c->header, "%d %d %d %d", &top, &left, &h, &w) != 4)
+    return 0;
+  if (top < 0 || left < 0 || h < 1 || w < 1) return 0;
+  if (top + h > rows || left + w > cols) return 0;
+  for (int i = 0; i < nclients; i++)
+    {
+    Client *o = &clients[i];
+    if (o->fd >= 0 || !o->term) continue;
+    if (o->top < top + h && top < o->top + o->term->get_rows()
+        && o->left < left + w && left < o->left + o->term->get_cols())
+      o->doomed = 1;
+    }
+  c->top = top;
+  c->left = left;
+  c->cm = new WindowMatrix (h, w);
+  c->term = new LCDTerm (*c->cm, LCDTERM_LF_IS_CRLF);
+  c->term->init();
+  dirty = 1;
+  return 1;
+  }
+
+/**
+ * client_input
+ * Returns 0 if the client has gone, or sent something unacceptable.
+ */
+static int client_input (Client *c)
+  {
+  Char buff[512];
+  ssize_t n = read (c->fd, buff, sizeof (buff));
+  if (n <= 0) return 0;
+
+  ssize_t i = 0;
+  while (!c->term && i < n)
+    {
+    char ch = buff[i++];
+    if (ch == '\n')
+      {
+      c->header[c->header_len] = 0;
+      if (!start_window (c)) return 0;
+      }
+    else if (c->header_len < HEADER_MAX - 1)
+      c->header[c->header_len++] = ch;
+    else
+      return 0;
+    }
+
+  for (; i < n; i++)
+    c->term->print (buff[i]);
+  if (i > 0) dirty = 1;
+  return 1;
+  }
+
+/**
+ * main
+ */
+int main (int argc, char **argv)
+  {
+  const char *device = "/dev/ttyACM0";
+  const char *path = "/tmp/lcdd.sock";
+  unsigned long interval = 100;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "d:s:r:c:i:")) != -1)
+    {
+    switch (opt)
+      {
+      case 'd': device = optarg; break;
+      case 's': path = optarg; break;
+      case 'r': rows = atoi (optarg); break;
+      case 'c': cols = atoi (optarg); break;
+      case 'i': interval = strtoul (optarg, NULL, 10); break;
+      default:
+        fprintf (stderr, "Usage: %s [-d device] [-s socket] [-r rows] "
+          "[-c cols] [-i msec]\n", argv[0]);
+        return 1;
+      }
+    }
+  if (rows < 1 || cols < 1 || rows > 4 || cols > 40)
+    {
+    fprintf (stderr, "%s: bad panel size\n", argv[0]);
+    return 1;
+    }
+
+  signal (SIGPIPE, SIG_IGN);
+  int dev = open_device (device);
+  if (dev < 0) return 1;
+  int sock = open_socket (path);
+  if (sock < 0) return 1;
+
+  sent = (Char *)calloc (rows * cols, 1);
+  screen = (Char *)calloc (rows * cols, 1);
+
+  // Start from a known state: blank screen, no cursor, and no wrap, so
+  //   that a run that ends on the bottom-right cell doesn't scroll the
+  //   panel out from under our model of it
+  if (write_all (dev, (const Char *)"\f\x13\x0e", 3) < 0)
+    {
+    perror (device);
+    return 1;
+    }
+
+  unsigned long last_update = 0;
+  for (;;)
+    {
+    struct pollfd fds[MAX_CLIENTS + 1];
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < nclients; i++)
+      {
+      fds[i + 1].fd = clients[i].fd;
+      fds[i + 1].events = POLLIN;
+      }
+
+    int timeout = -1;
+    if (dirty)
+      {
+      unsigned long since = now_msec() - last_update;
+      timeout = since >= interval ? 0 : interval - since;
+      }
+    if (poll (fds, nclients + 1, timeout) < 0)
+      {
+      if (errno == EINTR) continue;
+      perror ("poll");
+      return 1;
+      }
+
+    // poll() skips the clients that have gone, whose fd is -1
+    for (int i = 0; i < nclients; i++)
+      {
+      if (fds[i + 1].revents && !client_input (&clients[i]))
+        disconnect_client (&clients[i]);
+      }
+    remove_doomed();
+
+    if (fds[0].revents & POLLIN)
+      {
+      int fd = accept (sock, NULL, NULL);
+      if (fd >= 0)
+        {
+        // If there's no room, make some by forgetting the oldest
+        //   window whose client has gone
+        for (int i = 0; i < nclients && nclients == MAX_CLIENTS; i++)
+          if (clients[i].fd < 0) remove_client (i);
+        if (nclients < MAX_CLIENTS)
+          {
+          memset (&clients[nclients], 0, sizeof (Client));
+          clients[nclients].fd = fd;
+          nclients++;
+          }
+        else
+          close (fd);
+        }
+      }
+
+    if (dirty && now_msec() - last_update >= interval)
+      {
+      if (update (dev) < 0)
+        {
+        perror (device);
+        return 1;
+        }
+      last_update = now_msec();
+      }
+    }
+  }
@@ -0,0 +1,149 @@
+/**
+
+lcdemu
+
+A host program that feeds its standard input through LCDTerm to an
+emulated HD44780, wired as for LCDParallel, and prints what the panel
+would show when the input is exhausted. Useful for checking changes to
+LCDTerm and the HD44780 driver without flashing the board.
+
+Usage: lcdemu [-r rows] [-c cols] [-8] [-t msec] < input
+
+With -t, the terminal's clock is run on by the given number of
+(simulated) milliseconds after the input is exhausted, so that
+marquees, etc., move, alerts time out, and the clock (ESC T, ESC k)
+runs, from the time it was set at the start. Alert packets (see alert.h)
+are picked out of the input, and shown as soon as they are complete,
+as the firmware does. So are frames (ESC F, and ESC . to end one); a
+frame that is still open when the input is exhausted is committed, as
+the firmware would once the input went idle.
+
+Copyright (c)2021 Kevin Boone
+Distributed according to the terms of the GPL, v3.0
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lcdparallelemu.h"
+#include "lcdterm.h"
+#include "alert.h"
+#include "frame.h"
+#include "clock.h"
+
+static FrameMatrix *emu_frames;
+static Clock *emu_clock;
+
+/**
+ * commit_frame
+ */
+static void commit_frame (LCDTerm &term)
+  {
+  if (!emu_frames->holding()) return;
+  // Anything the terminal has held back is part of the frame
+  term.flush();
+#if LCDTERM_FEATURE_ATTRIBUTES
+  emu_frames->commit (term.get_buff(), term.get_attrs());
+  term.paint_attrs();
+#else
+  emu_frames->commit (term.get_buff());
+#endif
+  term.set_cursor (term.get_row(), term.get_col());
+  }
+
+/**
+ * handle_escape
+ * The escapes that the firmware handles outside LCDTerm, as far as
+ * they make sense here.
+ */
+static void handle_escape (LCDTerm &term, Char cmd, const Char *params,
+    uint8_t n)
+  {
+  switch (cmd)
+    {
+    case 'F':
+      emu_frames->set_enabled (params[0] - 32);
+      if (!emu_frames->is_enabled()) commit_frame (term);
+      break;
+    case '.':
+      commit_frame (term);
+      break;
+    case 'T':
+      emu_clock->set (params, n, 0);
+      break;
+    case 'k':
+      if (n >= 4)
+        emu_clock->set_field (params[0] - 32, params[1] - 32,
+          params[2] - 32, params[3] - 32, params + 4, n - 4);
+      break;
+    }
+  }
+
+/**
+ * main
+ */
+int main (int argc, char **argv)
+  {
+  int rows = 4;
+  int cols = 20;
+  uint8_t bus_mode = LCD_4BITMODE;
+  unsigned long run_time = 0;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "r:c:8t:")) != -1)
+    {
+    switch (opt)
+      {
+      case 'r': rows = atoi (optarg); break;
+      case 'c': cols = atoi (optarg); break;
+      case '8': bus_mode = LCD_8BITMODE; break;
+      case 't': run_time = strtoul (optarg, NULL, 10); break;
+      default:
+        fprintf (stderr, "Usage: %s [-r rows] [-c cols] [-8] [-t msec]\n", argv[0]);
+        return 1;
+      }
+    }
+
+  LCDParallelEmulated lcd (cols, rows, bus_mode);
+  AlertOverlay alerts (lcd);
+  FrameMatrix frames (alerts);
+  LCDTerm term (frames, LCDTERM_LF_IS_CRLF);
+  Clock clock (term);
+  emu_frames = &frames;
+  emu_clock = &clock;
+  term.set_escape_handler (handle_escape);
+  term.init();
+
+  int c;
+  while ((c = getchar()) != EOF)
+    {
+    if (alerts.take ((Char)c))
+      {
+      if (alerts.ready())
+        {
+        alerts.apply (frames.get_shown(), 0);
+        term.set_cursor (term.get_row(), term.get_col());
+        term.flush();
+        }
+      continue;
+      }
+    term.print ((Char)c);
+    }
+  term.flush();
+  commit_frame (term);
+
+  clock.tick (0);
+  for (unsigned long t = 1; t <= run_time; t++)
+    {
+    term.tick (t);
+    clock.tick (t);
+    if (alerts.tick (t))
+      term.set_cursor (term.get_row(), term.get_col());
+    term.flush();
+    }
+
+  lcd.dump (stdout);
+  fprintf (stderr, "%lu enable strobes\n", lcd.get_strobes());
+  return 0;
+  }
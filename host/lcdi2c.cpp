@@ -0,0 +1,104 @@
+/**
+
+lcdi2c
+
+A host program that drives an HD44780 panel with a PCF8574 backpack
+directly from a Linux I2C bus, using the same terminal code as the
+firmware. Standard input is displayed on the panel, so this can
+replace the Pro Micro on machines that have an I2C header.
+
+Usage: lcdi2c [-d /dev/i2c-N] [-a address] [-r rows] [-c cols] [-o file]
+
+With -o, the bytes that would be sent to the PCF8574 are written to
+the named file instead of the I2C bus.
+
+Copyright (c)2021 Kevin Boone
+Distributed according to the terms of the GPL, v3.0
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "lcd8574linux.h"
+#include "lcdterm.h"
+
+/**
+ * main
+ */
+int main (int argc, char **argv)
+  {
+  const char *device = "/dev/i2c-1";
+  const char *outfile = NULL;
+  int addr = 0x27;
+  int rows = 4;
+  int cols = 20;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "d:a:r:c:o:")) != -1)
+    {
+    switch (opt)
+      {
+      case 'd': device = optarg; break;
+      case 'a': addr = strtol (optarg, NULL, 0); break;
+      case 'r': rows = atoi (optarg); break;
+      case 'c': cols = atoi (optarg); break;
+      case 'o': outfile = optarg; break;
+      default:
+        fprintf (stderr, "Usage: %s [-d /dev/i2c-N] [-a address] "
+          "[-r rows] [-c cols] [-o file]\n", argv[0]);
+        return 1;
+      }
+    }
+
+  I2CDevBus devbus;
+  I2CBus *bus;
+  int fd = -1;
+  if (outfile)
+    {
+    fd = open (outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      {
+      perror (outfile);
+      return 1;
+      }
+    bus = new FdI2CBus (fd);
+    }
+  else
+    {
+    int e = devbus.open (device);
+    if (e)
+      {
+      fprintf (stderr, "%s: %s\n", device, strerror (e));
+      return 1;
+      }
+    bus = &devbus;
+    }
+
+  LCD8574Linux lcd (*bus, addr, cols, rows);
+  LCDTerm term (lcd, LCDTERM_LF_IS_CRLF);
+  term.init();
+  term.backlight_on();
+  term.cursor_on();
+  lcd.flush();
+
+  // Whatever arrives in one read goes to the panel in one transfer
+  //   (or a few, if it's large)
+  uint8_t buff[256];
+  ssize_t n;
+  while ((n = read (0, buff, sizeof (buff))) > 0)
+    {
+    for (ssize_t i = 0; i < n; i++)
+      term.print ((Char)buff[i]);
+    term.flush();
+    int e = lcd.get_error();
+    if (e)
+      fprintf (stderr, "I2C write failed: %s\n", strerror (e));
+    }
+
+  if (bus != &devbus) delete bus;
+  if (fd >= 0) close (fd);
+  return 0;
+  }
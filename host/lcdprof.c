@@ -0,0 +1,523 @@
+/**
+
+lcdprof
+
+A host program that runs the firmware under simavr, feeds it a
+recorded input stream, and reports how many CPU cycles it spends in
+the parts of the program that matter for throughput. Host builds of
+LCDTerm (lcdemu) show what the code does, but not what it costs on an
+8-bit AVR -- 16-bit arithmetic, virtual calls, and memmove are all
+much dearer there than on a PC.
+
+Usage: lcdprof [-m mcu] [-f freq] [-a address] [-r symbol] [-p usec]
+          [-t msec] [-g label=prefix] [-o file] -s symfile -i input
+          firmware.elf
+
+The firmware must be built to read its input from the UART, rather
+than USB, which simavr can't drive -- "make sim-profile" does this,
+and then runs this program. The symbol file is the output of
+"avr-nm -C -S -t d" on the same ELF file.
+
+Cycles are attributed to functions by program counter. A group's
+figure includes everything called from the functions in the group,
+and any interrupts that happen while they're running; the table of
+individual functions only counts the instructions in each function
+itself. Groups are matched by prefix of the demangled name, so
+"LCD8574Arduino::" catches every method of that class; a group can
+have several prefixes, separated by "|". A function
+that the compiler has inlined has no symbol, and shows up as part of
+its caller. The total includes the time the firmware spends waiting
+for input.
+
+The input is paced the way USB paces it: no more than a few bytes
+are allowed to be waiting in the firmware's receive buffer, counted
+by calls to the function named by -r. If there is no such function,
+a byte is sent every -p usec instead.
+
+With -o, the bytes that the firmware writes to the PCF8574 are
+written to the named file, in the same form as "lcdi2c -o".
+
+Copyright (c)2021 Kevin Boone
+Distributed according to the terms of the GPL, v3.0
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <avr_ioport.h>
+#include <avr_uart.h>
+#include <avr_twi.h>
+
+#define MAX_SYMS 4096
+#define MAX_GROUPS 16
+#define MAX_STACK 64
+#define MAX_INPUT 65536
+// Bytes allowed to wait in the firmware's receive buffer
+#define INPUT_WINDOW 4
+// Number of functions to list
+#define TOP_FUNCS 20
+
+typedef struct
+  {
+  uint32_t addr;
+  uint32_t size;
+  char *name;
+  uint32_t groups;     // Bit mask of the groups this symbol is in
+  uint64_t cycles;     // Exclusive
+  uint32_t calls;
+  } Sym;
+
+typedef struct
+  {
+  const char *label;
+  const char *prefix;
+  uint64_t cycles;     // Inclusive
+  uint32_t calls;
+  int depth;
+  int found;
+  } Group;
+
+typedef struct
+  {
+  int sym;
+  uint16_t sp;
+  } Frame;
+
+static Sym syms[MAX_SYMS];
+static int nsyms;
+static int *sym_at;    // Symbol index for each word of flash, or -1
+
+static Group groups[MAX_GROUPS] =
+  {
+  { "print_nonescape_char", "LCDTerm::print_nonescape_char", 0, 0, 0, 0 },
+  { "print_normal_char", "LCDTerm::print_normal_char", 0, 0, 0, 0 },
+  { "scroll_up", "LCDTerm::scroll_up", 0, 0, 0, 0 },
+  // The bus code sits behind the HD44780 driver, since the split, and
+  //   only the two together are the whole of the send path
+  { "PCF8574 send path", "HD44780::|LCD8574Arduino::", 0, 0, 0, 0 },
+  { "  of which Wire/TWI", "TwoWire::", 0, 0, 0, 0 },
+  { "  of which twi.c", "twi_", 0, 0, 0, 0 },
+  { "busy-wait delays", "delay", 0, 0, 0, 0 },
+  };
+static int ngroups = 7;
+
+static Frame stack[MAX_STACK];
+static int depth;
+
+static uint8_t twi_addr = 0x27;
+static int twi_selected;
+static uint32_t twi_bytes;
+static uint32_t twi_transactions;
+static FILE *twi_out;
+
+/**
+ * group_match
+ * Returns nonzero if name starts with any of the prefixes, separated
+ * by |, in prefix.
+ */
+static int group_match (const char *name, const char *prefix)
+  {
+  while (*prefix)
+    {
+    size_t len = strcspn (prefix, "|");
+    if (len && strncmp (name, prefix, len) == 0) return 1;
+    prefix += len;
+    if (*prefix) prefix++;
+    }
+  return 0;
+  }
+
+/**
+ * load_syms
+ * Read the text symbols from the output of avr-nm -C -S -t d. Each
+ * line is address, size, type, and then the name, which may contain
+ * spaces.
+ */
+static int load_syms (const char *file)
+  {
+  FILE *f = fopen (file, "r");
+  if (!f)
+    {
+    perror (file);
+    return -1;
+    }
+  char line[512];
+  while (fgets (line, sizeof (line), f) && nsyms < MAX_SYMS)
+    {
+    unsigned long addr, size;
+    char type;
+    int n;
+    if (sscanf (line, "%lu %lu %c %n", &addr, &size, &type, &n) != 3)
+      continue;
+    if (type != 't' && type != 'T' && type != 'w' && type != 'W')
+      continue;
+    if (size == 0) continue;
+    line[strcspn (line, "\n")] = 0;
+    Sym *s = &syms[nsyms++];
+    s->addr = addr;
+    s->size = size;
+    s->name = strdup (line + n);
+    for (int g = 0; g < ngroups; g++)
+      {
+      if (group_match (s->name, groups[g].prefix))
+        {
+        s->groups |= 1u << g;
+        groups[g].found = 1;
+        }
+      }
+    }
+  fclose (f);
+  return 0;
+  }
+
+/**
+ * find_sym
+ * Find the symbol whose name starts with prefix, or -1
+ */
+static int find_sym (const char *prefix)
+  {
+  for (int i = 0; i < nsyms; i++)
+    if (strncmp (syms[i].name, prefix, strlen (prefix)) == 0) return i;
+  return -1;
+  }
+
+/**
+ * map_syms
+ * Build the table that maps a program counter to a symbol.
+ */
+static void map_syms (uint32_t flash_size)
+  {
+  uint32_t words = flash_size / 2;
+  sym_at = malloc (words * sizeof (int));
+  for (uint32_t i = 0; i < words; i++) sym_at[i] = -1;
+  for (int i = 0; i < nsyms; i++)
+    {
+    for (uint32_t a = syms[i].addr; a < syms[i].addr + syms[i].size
+        && a < flash_size; a += 2)
+      sym_at[a / 2] = i;
+    }
+  }
+
+/**
+ * get_sp
+ */
+static uint16_t get_sp (avr_t *avr)
+  {
+  return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+  }
+
+/**
+ * enter
+ * Called when the program counter lands on the first instruction of
+ * a function.
+ */
+static void enter (int sym, uint16_t sp)
+  {
+  syms[sym].calls++;
+  if (!syms[sym].groups || depth == MAX_STACK) return;
+  stack[depth].sym = sym;
+  stack[depth].sp = sp;
+  depth++;
+  for (int g = 0; g < ngroups; g++)
+    {
+    if (syms[sym].groups & (1u << g))
+      {
+      if (groups[g].depth++ == 0) groups[g].calls++;
+      }
+    }
+  }
+
+/**
+ * leave
+ * Called after each return instruction. A frame is finished when the
+ * stack pointer is above where it was when the function was entered,
+ * which also deals with functions that were reached by a jump rather
+ * than a call.
+ */
+static void leave (uint16_t sp)
+  {
+  while (depth > 0 && sp > stack[depth - 1].sp)
+    {
+    depth--;
+    uint32_t mask = syms[stack[depth].sym].groups;
+    for (int g = 0; g < ngroups; g++)
+      if (mask & (1u << g)) groups[g].depth--;
+    }
+  }
+
+/**
+ * twi_hook
+ * Act as a PCF8574 at twi_addr: acknowledge its address, and
+ * acknowledge and record each byte written to it.
+ */
+static void twi_hook (struct avr_irq_t *irq, uint32_t value, void *param)
+  {
+  avr_irq_t *in = (avr_irq_t *)param;
+  avr_twi_msg_irq_t v;
+  (void)irq;
+  v.u.v = value;
+
+  if (v.u.twi.msg & TWI_COND_STOP)
+    twi_selected = 0;
+
+  if (v.u.twi.msg & TWI_COND_ADDR)
+    {
+    twi_selected = (v.u.twi.addr >> 1) == twi_addr;
+    if (twi_selected)
+      {
+      twi_transactions++;
+      avr_raise_irq (in, avr_twi_irq_msg (TWI_COND_ACK, v.u.twi.addr, 1));
+      }
+    }
+  else if (twi_selected && (v.u.twi.msg & TWI_COND_WRITE))
+    {
+    twi_bytes++;
+    if (twi_out) fputc (v.u.twi.data, twi_out);
+    avr_raise_irq (in, avr_twi_irq_msg (TWI_COND_ACK, twi_addr << 1, 1));
+    }
+  }
+
+/**
+ * print_report
+ */
+static void print_report (uint64_t total, uint32_t freq, uint32_t bytes)
+  {
+  uint32_t per = bytes ? bytes : 1;
+
+  printf ("Input: %u bytes, %llu cycles (%.1f msec)\n", bytes,
+    (unsigned long long)total, total * 1000.0 / freq);
+  printf ("PCF8574: %u transactions, %u bytes\n\n", twi_transactions,
+    twi_bytes);
+
+  printf ("%-22s %8s %12s %10s %6s\n", "Group", "calls", "cycles",
+    "per byte", "%");
+  for (int g = 0; g < ngroups; g++)
+    {
+    Group *gr = &groups[g];
+    if (!gr->found)
+      {
+      printf ("%-22s   (no symbol -- inlined?)\n", gr->label);
+      continue;
+      }
+    printf ("%-22s %8u %12llu %10.1f %6.1f\n", gr->label, gr->calls,
+      (unsigned long long)gr->cycles, (double)gr->cycles / per,
+      total ? gr->cycles * 100.0 / total : 0.0);
+    }
+
+  printf ("\nFunctions, by cycles spent in the function itself:\n");
+  printf ("%12s %10s %8s  %s\n", "cycles", "per byte", "calls", "name");
+  for (int n = 0; n < TOP_FUNCS; n++)
+    {
+    int best = -1;
+    for (int i = 0; i < nsyms; i++)
+      {
+      if (syms[i].cycles && (best < 0 || syms[i].cycles > syms[best].cycles))
+        best = i;
+      }
+    if (best < 0) break;
+    printf ("%12llu %10.1f %8u  %s\n",
+      (unsigned long long)syms[best].cycles,
+      (double)syms[best].cycles / per, syms[best].calls, syms[best].name);
+    syms[best].cycles = 0;
+    }
+  }
+
+/**
+ * main
+ */
+int main (int argc, char **argv)
+  {
+  const char *mcu = "atmega32u4";
+  uint32_t freq = 16000000;
+  const char *symfile = NULL;
+  const char *infile = NULL;
+  const char *outfile = NULL;
+  const char *read_sym = "HardwareSerial::read";
+  unsigned long pace_us = 2000;
+  unsigned long settle_ms = 20;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "m:f:a:r:p:t:g:o:s:i:")) != -1)
+    {
+    switch (opt)
+      {
+      case 'm': mcu = optarg; break;
+      case 'f': freq = strtoul (optarg, NULL, 10); break;
+      case 'a': twi_addr = strtol (optarg, NULL, 0); break;
+      case 'r': read_sym = optarg; break;
+      case 'p': pace_us = strtoul (optarg, NULL, 10); break;
+      case 't': settle_ms = strtoul (optarg, NULL, 10); break;
+      case 'o': outfile = optarg; break;
+      case 's': symfile = optarg; break;
+      case 'i': infile = optarg; break;
+      case 'g':
+        {
+        char *eq = strchr (optarg, '=');
+        if (!eq || ngroups == MAX_GROUPS)
+          {
+          fprintf (stderr, "%s: bad group %s\n", argv[0], optarg);
+          return 1;
+          }
+        *eq = 0;
+        groups[ngroups].label = optarg;
+        groups[ngroups].prefix = eq + 1;
+        ngroups++;
+        break;
+        }
+      default:
+        fprintf (stderr, "Usage: %s [-m mcu] [-f freq] [-a address] "
+          "[-r symbol] [-p usec] [-t msec] [-g label=prefix] [-o file] "
+          "-s symfile -i input firmware.elf\n", argv[0]);
+        return 1;
+      }
+    }
+  if (!symfile || !infile || optind != argc - 1)
+    {
+    fprintf (stderr, "%s: a symbol file, an input file, and a firmware "
+      "file are all needed\n", argv[0]);
+    return 1;
+    }
+
+  static uint8_t input[MAX_INPUT];
+  FILE *f = fopen (infile, "rb");
+  if (!f)
+    {
+    perror (infile);
+    return 1;
+    }
+  uint32_t input_len = fread (input, 1, sizeof (input), f);
+  fclose (f);
+
+  if (outfile)
+    {
+    twi_out = fopen (outfile, "wb");
+    if (!twi_out)
+      {
+      perror (outfile);
+      return 1;
+      }
+    }
+
+  if (load_syms (symfile)) return 1;
+
+  elf_firmware_t fw;
+  memset (&fw, 0, sizeof (fw));
+  if (elf_read_firmware (argv[optind], &fw))
+    {
+    fprintf (stderr, "%s: can't load %s\n", argv[0], argv[optind]);
+    return 1;
+    }
+  strncpy (fw.mmcu, mcu, sizeof (fw.mmcu) - 1);
+  fw.frequency = freq;
+
+  avr_t *avr = avr_make_mcu_by_name (fw.mmcu);
+  if (!avr)
+    {
+    fprintf (stderr, "%s: simavr doesn't know %s\n", argv[0], fw.mmcu);
+    return 1;
+    }
+  avr_init (avr);
+  avr_load_firmware (avr, &fw);
+  map_syms (avr->flashend + 1);
+
+  // Don't let simavr copy the UART to stdout
+  uint32_t flags = 0;
+  avr_ioctl (avr, AVR_IOCTL_UART_GET_FLAGS ('1'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl (avr, AVR_IOCTL_UART_SET_FLAGS ('1'), &flags);
+  avr_irq_t *uart_in = avr_io_getirq (avr, AVR_IOCTL_UART_GETIRQ ('1'),
+    UART_IRQ_INPUT);
+
+  avr_irq_t *twi_in = avr_io_getirq (avr, AVR_IOCTL_TWI_GETIRQ (0),
+    TWI_IRQ_INPUT);
+  avr_irq_register_notify (avr_io_getirq (avr, AVR_IOCTL_TWI_GETIRQ (0),
+    TWI_IRQ_OUTPUT), twi_hook, twi_in);
+
+  int read_idx = find_sym (read_sym);
+  if (read_idx < 0)
+    fprintf (stderr, "%s: no symbol %s; sending a byte every %lu usec\n",
+      argv[0], read_sym, pace_us);
+  int loop_idx = find_sym ("loop");
+
+  // Don't count the time taken to initialize the panel -- start the
+  //   clock when the firmware first gets to loop()
+  uint64_t pace_cycles = (uint64_t)pace_us * freq / 1000000;
+  uint64_t settle_cycles = (uint64_t)settle_ms * freq / 1000;
+  uint64_t start = 0, next_send = 0, done_at = 0;
+  int started = loop_idx < 0;
+  uint32_t sent = 0;
+  int state = cpu_Running;
+
+  while (state != cpu_Done && state != cpu_Crashed)
+    {
+    avr_flashaddr_t pc = avr->pc;
+    avr_cycle_count_t before = avr->cycle;
+    uint16_t op = avr->flash[pc] | (avr->flash[pc + 1] << 8);
+    int sym = sym_at[pc / 2];
+
+    state = avr_run (avr);
+
+    uint64_t spent = avr->cycle - before;
+    if (started)
+      {
+      if (sym >= 0) syms[sym].cycles += spent;
+      for (int g = 0; g < ngroups; g++)
+        if (groups[g].depth > 0) groups[g].cycles += spent;
+      }
+
+    // ret or reti
+    if (op == 0x9508 || op == 0x9518)
+      leave (get_sp (avr));
+    int now = sym_at[avr->pc / 2];
+    if (now >= 0 && now != sym && avr->pc == syms[now].addr)
+      {
+      if (now == loop_idx && !started)
+        {
+        started = 1;
+        start = avr->cycle;
+        for (int i = 0; i < nsyms; i++) syms[i].calls = 0;
+        for (int g = 0; g < ngroups; g++) groups[g].calls = 0;
+        }
+      enter (now, get_sp (avr));
+      }
+
+    if (!started) continue;
+
+    if (sent < input_len)
+      {
+      int ready;
+      if (read_idx >= 0)
+        ready = sent - syms[read_idx].calls < INPUT_WINDOW;
+      else
+        ready = avr->cycle >= next_send;
+      if (ready)
+        {
+        avr_raise_irq (uart_in, input[sent++]);
+        next_send = avr->cycle + pace_cycles;
+        }
+      }
+    else if (!done_at)
+      {
+      if (read_idx < 0 || syms[read_idx].calls >= sent)
+        done_at = avr->cycle;
+      }
+    else if (avr->cycle - done_at >= settle_cycles)
+      {
+      break;
+      }
+    }
+
+  if (state == cpu_Crashed)
+    fprintf (stderr, "%s: firmware crashed at pc 0x%04x\n", argv[0],
+      (unsigned)avr->pc);
+
+  print_report (avr->cycle - start, freq, sent);
+  if (twi_out) fclose (twi_out);
+  return 0;
+  }
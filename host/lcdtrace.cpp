@@ -0,0 +1,293 @@
+/**
+
+lcdtrace
+
+A host program that turns the firmware's event trace (see trace.h)
+into latency histograms, to show where the time goes between the host
+sending a byte and the panel showing it.
+
+Usage: lcdtrace [-d /dev/ttyACMn] [< dump]
+
+With -d, the trace is fetched from the board by sending ESC q to the
+named serial device. Otherwise, a dump that has already been captured
+is read from standard input. The firmware has to be built with
+LCD_FEATURE_TRACE -- "make PROFILE=full", for example.
+
+The stages are:
+
+  waiting  -- from the end of one byte to the arrival of the next, when
+              nothing else was queued; the time the firmware was
+              idle, waiting for the host
+  byte     -- from reading a byte from the host to having finished
+              with it, including the time it spent queued behind
+              earlier bytes
+  scroll   -- the same, but only for bytes that caused a scroll
+  clear    -- the same, but only for bytes that cleared the screen
+  flush    -- each bulk write to the panel (repaints and scrolls)
+
+Copyright (c)2021 Kevin Boone
+Distributed according to the terms of the GPL, v3.0
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include "trace.h"
+
+// Histogram buckets are powers of two, in usec: 1, 2-3, 4-7, ...
+#define BUCKETS 32
+// Width of the longest bar
+#define BAR_WIDTH 40
+// Time to wait for the board to send the trace, msec
+#define DUMP_TIMEOUT 2000
+// Most bytes that can have been read, and not yet finished with -- the
+//   firmware's whole trace, at most
+#define RX_QUEUE 256
+
+typedef struct
+  {
+  const char *name;
+  uint32_t buckets[BUCKETS];
+  uint32_t n;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  } Stage;
+
+static Stage waiting = { "waiting", {}, 0, 0, 0, 0 };
+static Stage byte = { "byte", {}, 0, 0, 0, 0 };
+static Stage scroll = { "scroll", {}, 0, 0, 0, 0 };
+static Stage clear = { "clear", {}, 0, 0, 0, 0 };
+static Stage flush = { "flush", {}, 0, 0, 0, 0 };
+
+/**
+ * add
+ * Add a sample to a stage
+ */
+static void add (Stage *s, uint32_t usec)
+  {
+  int b = 0;
+  while (b < BUCKETS - 1 && (usec >> b) > 1) b++;
+  s->buckets[b]++;
+  if (s->n == 0 || usec < s->min) s->min = usec;
+  if (usec > s->max) s->max = usec;
+  s->sum += usec;
+  s->n++;
+  }
+
+/**
+ * show
+ * Print a stage's figures and histogram, leaving out the empty
+ * buckets at either end.
+ */
+static void show (const Stage *s)
+  {
+  if (s->n == 0)
+    {
+    printf ("%s: no samples\n\n", s->name);
+    return;
+    }
+  printf ("%s: %u samples, min %u, mean %llu, max %u usec\n", s->name,
+    s->n, s->min, (unsigned long long)(s->sum / s->n), s->max);
+
+  int first = 0, last = BUCKETS - 1;
+  uint32_t most = 0;
+  while (s->buckets[first] == 0) first++;
+  while (s->buckets[last] == 0) last--;
+  for (int b = first; b <= last; b++)
+    if (s->buckets[b] > most) most = s->buckets[b];
+
+  for (int b = first; b <= last; b++)
+    {
+    uint32_t lo = b ? 1u << b : 0;
+    uint32_t hi = (b < 31 ? (1u << (b + 1)) : 0) - 1;
+    int len = (int)((uint64_t)s->buckets[b] * BAR_WIDTH / most);
+    printf ("  %10u-%-10u |", lo, hi);
+    for (int i = 0; i < len; i++) putchar ('#');
+    printf ("%*s %u\n", BAR_WIDTH - len, "", s->buckets[b]);
+    }
+  printf ("\n");
+  }
+
+/**
+ * open_device
+ * Open the board's serial device, in raw mode, and ask for the trace.
+ */
+static int open_device (const char *device)
+  {
+  int fd = open (device, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+    {
+    perror (device);
+    return -1;
+    }
+  struct termios t;
+  if (tcgetattr (fd, &t) == 0)
+    {
+    cfmakeraw (&t);
+    tcsetattr (fd, TCSANOW, &t);
+    }
+  tcflush (fd, TCIFLUSH);
+  if (write (fd, "\033q", 2) != 2)
+    {
+    perror (device);
+    close (fd);
+    return -1;
+    }
+  return fd;
+  }
+
+/**
+ * read_line
+ * Read a line from fd, giving up if nothing arrives for DUMP_TIMEOUT.
+ * Returns 0 at the end of the input.
+ */
+static int read_line (int fd, char *line, int size)
+  {
+  int n = 0;
+  for (;;)
+    {
+    struct pollfd p = { fd, POLLIN, 0 };
+    if (poll (&p, 1, DUMP_TIMEOUT) <= 0) break;
+    char c;
+    if (read (fd, &c, 1) != 1) break;
+    if (c == '\r') continue;
+    if (c == '\n')
+      {
+      line[n] = 0;
+      return 1;
+      }
+    if (n < size - 1) line[n++] = c;
+    }
+  line[n] = 0;
+  return n > 0;
+  }
+
+/**
+ * main
+ */
+int main (int argc, char **argv)
+  {
+  const char *device = NULL;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "d:")) != -1)
+    {
+    switch (opt)
+      {
+      case 'd': device = optarg; break;
+      default:
+        fprintf (stderr, "Usage: %s [-d /dev/ttyACMn] [< dump]\n",
+          argv[0]);
+        return 1;
+      }
+    }
+
+  int fd = 0;
+  if (device)
+    {
+    fd = open_device (device);
+    if (fd < 0) return 1;
+    }
+
+  // Bytes are read from the host in bursts, and finished with later, in
+  //   the same order, so the times they were read are queued until then
+  uint32_t rx_time[RX_QUEUE];
+  uint8_t rx_byte[RX_QUEUE];
+  unsigned rx_head = 0, rx_tail = 0;
+  // End of the last byte, and start of the flush in progress, if any
+  uint32_t parsed = 0, flush_start = 0;
+  int have_parsed = 0, in_flush = 0;
+  int scrolled = 0, cleared = 0;
+  uint32_t events = 0, errors = 0, recoveries = 0;
+  unsigned count = 0, lost = 0;
+  int ended = 0;
+  char line[80];
+
+  while (read_line (fd, line, sizeof (line)))
+    {
+    if (strcmp (line, "end") == 0)
+      {
+      ended = 1;
+      break;
+      }
+    if (sscanf (line, "trace %u %u", &count, &lost) == 2)
+      continue;
+
+    unsigned long time;
+    char type;
+    unsigned arg;
+    if (sscanf (line, "%lu %c %u", &time, &type, &arg) != 3)
+      continue;
+    uint32_t t = (uint32_t)time;
+    events++;
+
+    // Differences are taken in 32 bits, so that they come out right
+    //   when micros() wraps around
+    switch (type)
+      {
+      case TRACE_RX:
+        if (have_parsed && rx_head == rx_tail) add (&waiting, t - parsed);
+        if (rx_head - rx_tail < RX_QUEUE)
+          {
+          rx_time[rx_head % RX_QUEUE] = t;
+          rx_byte[rx_head % RX_QUEUE] = arg;
+          rx_head++;
+          }
+        break;
+      case TRACE_PARSED:
+        // A byte whose arrival is older than the trace can't be timed
+        if (rx_head != rx_tail && rx_byte[rx_tail % RX_QUEUE] == arg)
+          {
+          uint32_t rx = rx_time[rx_tail++ % RX_QUEUE];
+          add (&byte, t - rx);
+          if (scrolled) add (&scroll, t - rx);
+          if (cleared) add (&clear, t - rx);
+          }
+        parsed = t;
+        have_parsed = 1;
+        scrolled = cleared = 0;
+        break;
+      case TRACE_FLUSH_START:
+        flush_start = t;
+        in_flush = 1;
+        break;
+      case TRACE_FLUSH_END:
+        if (in_flush) add (&flush, t - flush_start);
+        in_flush = 0;
+        break;
+      case TRACE_SCROLL:
+        scrolled = 1;
+        break;
+      case TRACE_CLEAR:
+        cleared = 1;
+        break;
+      case TRACE_I2C_ERROR:
+        errors++;
+        break;
+      case TRACE_RECOVER:
+        if (arg) recoveries++;
+        break;
+      }
+    }
+
+  if (device) close (fd);
+  if (!ended)
+    fprintf (stderr, "%s: trace is incomplete\n", argv[0]);
+
+  printf ("%u events", events);
+  if (lost) printf (" (%u older events lost)", lost);
+  printf (", %u I2C errors, %u recoveries\n\n", errors, recoveries);
+  show (&waiting);
+  show (&byte);
+  show (&scroll);
+  show (&clear);
+  show (&flush);
+  return 0;
+  }
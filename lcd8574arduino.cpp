@@ -1,10 +1,10 @@
 /*==========================================================================
-  
+
     lcd8574_arduino.c
 
-    Implementation of the class that is specified in 
-    lcd8574_arduino.h. This file contains methods for initializing the LCD 
-    module and writing text to it.
+    Implementation of the class that is specified in
+    lcd8574_arduino.h. This file contains the methods that get data
+    from the HD44780 driver to the LCD module, by way of the PCF8574.
 
     Datasheet for the HD44780:
     https://www.sparkfun.com/datasheets/LCD/HD44780.pdf
@@ -20,13 +20,14 @@
 #include <Wire.h>
 
 #include "lcd8574arduino.h"
+#include "trace.h"
 
 // These first few defines map the wiring of the D(n) pins on the
 // 8547 i2c-to-parallel IC to the lines of the LCD display.
 // They will need to be changed if you've not used the same wiring as
 //   I have.
 // For the record, my wiring is:
-// Register select (cmd/data) -- pin D0 
+// Register select (cmd/data) -- pin D0
 // R/W (not used here) -- pin D1
 // Clock (enable) -- pin D2
 // LED backlight -- pin D3
@@ -36,345 +37,111 @@
 // Cmd/data (register select) flag -- pin 0 = B1
 #define LCD_CMDDATA_FLAG 1
 
-// R/W bit (for completeness) -- pin 1 = B10. Not used at present
-#define LCD_RW_FLAG B00000010  
+// R/W bit (for completeness) -- pin 1 = B10. Not used as R/W, since
+//   the panel's R/W is tied low; on a 40x4 panel, which has two
+//   controllers, this pin drives the second enable line, E2
+#define LCD_RW_FLAG B00000010
+#define LCD_ENABLE2_FLAG LCD_RW_FLAG
 
-// Flag for enable (clock) line -- pin 2 = B100 
-#define LCD_ENABLE_FLAG B00000100  
+// Flag for enable (clock) line -- pin 2 = B100
+#define LCD_ENABLE_FLAG B00000100
 
 // Flags for backlight control -- pin 4 = B1000
-#define LCD_BACKLIGHT_FLAG B1000 
-
-// HD44780 LCD module command set (see datasheet)
-#define LCD_CLEARDISPLAY 0x01
-#define LCD_RETURNHOME 0x02
-#define LCD_ENTRYMODESET 0x04
-#define LCD_DISPLAYCONTROL 0x08
-#define LCD_CURSORSHIFT 0x10
-#define LCD_FUNCTIONSET 0x20
-#define LCD_SETCGRAMADDR 0x40
-#define LCD_SETDDRAMADDR 0x80
-
-// HD44780 flags for text layout mode
-#define LCD_ENTRYRIGHT 0x00
-#define LCD_ENTRYLEFT 0x02
-#define LCD_ENTRYSHIFTINCREMENT 0x01
-#define LCD_ENTRYSHIFTDECREMENT 0x00
-
-// HD44780 flags for display mode (power, cursor, etc) 
-#define LCD_DISPLAYON 0x04
-#define LCD_DISPLAYOFF 0x00
-#define LCD_CURSORON 0x02
-#define LCD_CURSOROFF 0x00
-#define LCD_BLINKON 0x01
-#define LCD_BLINKOFF 0x00
+#define LCD_BACKLIGHT_FLAG B1000
 
-// HD44780 flags for cursor and text scrolling 
-#define LCD_DISPLAYMOVE 0x08
-#define LCD_CURSORMOVE 0x00
-#define LCD_MOVERIGHT 0x04
-#define LCD_MOVELEFT 0x00
-
-// HD44780 flags for hardware mode 
-#define LCD_8BITMODE 0x10
-#define LCD_4BITMODE 0x00
-#define LCD_2LINE 0x08
-#define LCD_1LINE 0x00
+// The longest that an I2C transaction may take, in usec, before it is
+//   abandoned, and the TWI hardware reset. Without this, a glitch that
+//   leaves SDA low would hang the firmware for good
+#define LCD_I2C_TIMEOUT_USEC 5000
 
 
 /**
  * LCD8574Arduino constructor
  */
-LCD8574Arduino::LCD8574Arduino (uint8_t lcdi2c_addr, 
+LCD8574Arduino::LCD8574Arduino (uint8_t lcdi2c_addr,
     uint8_t _cols, uint8_t _rows, uint8_t charsize)
+  : HD44780 (_cols, _rows, charsize, LCD_4BITMODE)
   {
   i2c_addr = lcdi2c_addr;
-  cols = _cols;
-  rows = _rows;
-  charsize = charsize;
   // Turn backlight one by default -- display is useless without it
   backlight_flag = LCD_BACKLIGHT_FLAG;
   }
 
 /**
- * init
+ * bus_init
  */
-void LCD8574Arduino::init()
+void LCD8574Arduino::bus_init (void)
   {
   Wire.begin();
-
-  hardware_mode = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
-  if (rows > 1) 
-    {
-    hardware_mode |= LCD_2LINE;
-    }
-
-  // for some 1 line displays you can select a 10 pixel high font
-  if ((charsize != 0) && (rows == 1)) 
-    {
-    hardware_mode |= LCD_5x10DOTS;
-    }
-
-  delay(50); 
-  
-  // Now we pull both RS and R/W low to begin commands
-  write_i2c_byte (backlight_flag);	
-  delay(1000);
-
-  // Set into 4-bit mode
-  //  // Now... this is all a bit nasty...
-  // We need to set 4-bit mode, but the LCD module powers up in
-  //  eight bit mode. We can't be sure this is the first program
-  //  to use the LCD since power-up, so we don't know what
-  //  mode it's in. And we need to issue a command to set 4-bit
-  //  mode -- without knowing what mode we're in. So first we have
-  //  to enable 8-bit mode and then, knowing we're in 8-bit mode,
-  //  we must set 4-bit mode. Setting 8-bit mode without knowing the
-  //  current mode can be accomplished by sending the mode-setting
-  //  command as three identical 4-bit commands. If we start in
-  //  8-bit mode, some of these commands are gibberish 8-bit
-  //  commands with four of their bits set wrongly. But there's still
-  //  enough coherence for the module to get the message with thi
-  //  command sequence. This method of setting the mode is widely
-  //  used, even though it isn't documented, and it seems to work OK.
-
-  write4bits (0x03 << 4);
-  delayMicroseconds(4500); 
-   
-  write4bits(0x03 << 4);
-  delayMicroseconds(4500); 
-   
-  write4bits(0x03 << 4); 
-  delayMicroseconds(150);
-   
-  write4bits(0x02 << 4); 
-
-  command (LCD_FUNCTIONSET | hardware_mode);  
-	
-  display_mode = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
-  display_on();
-	
-  // Initialize text handling settings 
-  text_handling_mode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
-  command (LCD_ENTRYMODESET | text_handling_mode);
+#ifdef WIRE_HAS_TIMEOUT
+  Wire.setWireTimeout (LCD_I2C_TIMEOUT_USEC, true);
+#endif
+  write_i2c_byte (backlight_flag);
   }
 
 /**
- * clear
- * Note that the hardware implicitly resets the cursor, so we must reflect
- * that in the saved position
- */
-void LCD8574Arduino::clear()
-  {
-  command (LCD_CLEARDISPLAY);
-  delayMicroseconds (2000);  
-  }
-
-/** 
- * set_cursor 
- */
-void LCD8574Arduino::set_cursor (uint8_t row, uint8_t col)
-  {
-  static int row_offsets[] = { 0x00, 0x40, 0x14, 0x54 };
-  if (row < rows) 
-    {
-    command (LCD_SETDDRAMADDR | (col + row_offsets[row]));
-    }
-  }
-
-/** 
- * display_off
- */
-void LCD8574Arduino::display_off (void) 
-  {
-  display_mode &= ~LCD_DISPLAYON;
-  command(LCD_DISPLAYCONTROL | display_mode);
-  }
-
-/** 
- * display_on 
- */
-void LCD8574Arduino::display_on (void) 
-  {
-  display_mode |= LCD_DISPLAYON;
-  command(LCD_DISPLAYCONTROL | display_mode);
-  }
-
-/** 
- * cursor_off
- */
-void LCD8574Arduino::cursor_off (void) 
-  {
-  display_mode &= ~LCD_CURSORON;
-  command(LCD_DISPLAYCONTROL | display_mode);
-  }
-
-/** 
- * cursor_on 
- */
-void LCD8574Arduino::cursor_on (void) 
-  {
-  display_mode |= LCD_CURSORON;
-  command (LCD_DISPLAYCONTROL | display_mode);
-  }
-
-/** 
- * blink off 
- */
-void LCD8574Arduino::blink_off (void) 
-  {
-  display_mode &= ~LCD_BLINKON;
-  command(LCD_DISPLAYCONTROL | display_mode);
-  } 
-
-/** 
- * blink on 
- */
-void LCD8574Arduino::blink_on (void) 
-  {
-  display_mode |= LCD_BLINKON;
-  command(LCD_DISPLAYCONTROL | display_mode);
-  }
-
-/** 
- * scroll_left
- */
-void LCD8574Arduino::scroll_left (void) 
-  {
-  command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
-  }
-
-/** 
- * scroll_right
+ * bus_reset
+ * Turn the TWI hardware off and on again, in case it's the AVR end that
+ * has got stuck.
  */
-void LCD8574Arduino::scroll_right (void) 
+void LCD8574Arduino::bus_reset (void)
   {
-  command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVERIGHT);
+  Wire.end();
+  bus_init();
   }
 
-/** 
- * left_to_right
- */
-void LCD8574Arduino::left_to_right (void) 
-  {
-  text_handling_mode |= LCD_ENTRYLEFT;
-  command(LCD_ENTRYMODESET | text_handling_mode);
-  }
-
-/** 
- * right_to_left
- */
-void LCD8574Arduino::right_to_left (void) 
-  {
-  text_handling_mode &= ~LCD_ENTRYLEFT;
-  command(LCD_ENTRYMODESET | text_handling_mode);
-  }
-
-/** 
- * autoscroll_on 
- */
-void LCD8574Arduino::autoscroll_on (void) 
-  {
-  text_handling_mode |= LCD_ENTRYSHIFTINCREMENT;
-  command (LCD_ENTRYMODESET | text_handling_mode);
-  }
-
-/** 
- * autoscroll_off
+/**
+ * bus_ready
+ * The PCF8574 and the panel share a power supply, so once the expander
+ * acknowledges its address, the panel has power too.
  */
-void LCD8574Arduino::autoscroll_off (void) 
+uint8_t LCD8574Arduino::bus_ready (void)
   {
-  text_handling_mode &= ~LCD_ENTRYSHIFTINCREMENT;
-  command (LCD_ENTRYMODESET | text_handling_mode);
+  Wire.beginTransmission (i2c_addr);
+  return Wire.endTransmission() == 0;
   }
 
 /**
- * backlight_off
+ * write_bus
+ * The PCF8574 is wired for 4-bit mode, so we only ever send the
+ * top four bits of value, along with the cmd/data flag.
  */
-void LCD8574Arduino::backlight_off (void) 
+void LCD8574Arduino::write_bus (uint8_t value, uint8_t data_mode)
   {
-  // Write a dummy (NOP) command, just to set the 
-  //  backlight pin 
-  backlight_flag = 0;
-  write_i2c_byte (0);
+  uint8_t flag;
+  if (data_mode)
+    flag = LCD_CMDDATA_FLAG;
+  else
+     flag = 0;
+  write4bits ((value & 0xf0) | flag);
   }
 
 /**
- * backlight_on
+ * set_backlight
  */
-void LCD8574Arduino::backlight_on (void) 
+void LCD8574Arduino::set_backlight (uint8_t on)
   {
-  backlight_flag = LCD_BACKLIGHT_FLAG;
-  // Write a dummy (NOP) command, just to set the 
-  //  backlight pin 
+  if (on)
+    backlight_flag = LCD_BACKLIGHT_FLAG;
+  else
+    backlight_flag = 0;
+  // Write a dummy (NOP) command, just to set the
+  //  backlight pin
   write_i2c_byte (0);
   }
 
-/** 
- * write_char_at
- */
-void LCD8574Arduino::write_char_at (uint8_t row, uint8_t col, Char c)
-  {
-  if (c == 0) c = 32; // Make null into space
-  if (row < rows && col < cols)
-    {
-    set_cursor (row, col);
-    send_byte (c, 1);
-    }
-  }
-
-/** get_rows */
-uint8_t LCD8574Arduino::get_rows (void)
-  {
-  return rows;
-  }
-
-/** get_cols */
-uint8_t LCD8574Arduino::get_cols (void)
-  {
-  return cols;
-  }
-
 
 /* =========================================================================
        private functions below this point
 =========================================================================*/
 
-/** 
- * command
- * Send a command to the display. That is, sent a byte, with the
- * cmd/data pin set low 
- */
-inline void LCD8574Arduino::command (uint8_t value) 
-  {
-  send_byte (value, 0);
-  }
-
-/** 
- * send_byte
- * Send a byte as two four-bit blocks, with the cmd/data mode pin
- * set as specific. This should be zero for commands, and one for data
- */
-void LCD8574Arduino::send_byte (uint8_t value, uint8_t data_mode) 
-  {
-  uint8_t high = value & 0xf0;
-  uint8_t low = (value<<4) & 0xf0;
-  uint8_t flag;
-  if (data_mode)
-    flag = LCD_CMDDATA_FLAG;
-  else
-     flag = 0;
-  write4bits (high | flag);
-  write4bits (low | flag); 
-  }
-
 /**
  * write4bits
  * Write a 4-bit block. We actually send 8 bits, because that is how
  * the i2c-to-parallel conversion works. The 4 non-data bits reflect
  * cmd/data selection, backlight, etc.
  */
-void LCD8574Arduino::write4bits (uint8_t value) 
+void LCD8574Arduino::write4bits (uint8_t value)
   {
   write_i2c_byte (value);
   do_clock (value);
@@ -384,29 +151,39 @@ void LCD8574Arduino::write4bits (uint8_t value)
  * Write a single byte onto the I2C channel, using the Wire library.
  * Note that one of the outputs of the 8547 might be connected to the
  * backlight. We need to keep this output at the present value, whatever
- * other data bits are set.
+ * other data bits are set. Once a write has failed, the panel is out of
+ * step, and nothing more is sent until it has been recovered -- each
+ * failure can take a while, and there's no point.
  */
 void LCD8574Arduino::write_i2c_byte (uint8_t data)
-  {                                        
+  {
+  if (bus_fault) return;
   Wire.beginTransmission (i2c_addr);
   Wire.write ((int)(data) | backlight_flag);
-  Wire.endTransmission();   
+  uint8_t status = Wire.endTransmission();
+  if (status)
+    {
+    TRACE (TRACE_I2C_ERROR, status);
+    note_bus_error();
+    }
   }
 
 /** do_clock
- * Take the clock (enable) high for one microsecond, then 
- * low for 50 microseconds, while keeping the other outputs
+ * Take the clock (enable) high for one microsecond, then
+ * low for exec_usec microseconds, while keeping the other outputs
  * of the 8547 (as specified in data)
  * the same. This has the effect of strobing only
  * the clock line. We use this function to clock in commands and
- * data, four bits at a time. 
+ * data, four bits at a time.
  */
 void LCD8574Arduino::do_clock(uint8_t data)
   {
-  write_i2c_byte (data | LCD_ENABLE_FLAG);	
-  delayMicroseconds(1);		
-  write_i2c_byte (data & ~LCD_ENABLE_FLAG);	
-  // Allow at least 37 usec to settle
-  delayMicroseconds(50);
-  } 
+  uint8_t enable = controller ? LCD_ENABLE2_FLAG : LCD_ENABLE_FLAG;
+  write_i2c_byte (data | enable);
+  delayMicroseconds(1);
+  write_i2c_byte (data & ~enable);
+  // Allow the command to complete -- or, when HD44780 is alternating
+  //   between the two controllers of a 40x4 panel, half of it
+  delayMicroseconds (exec_usec);
+  }
 
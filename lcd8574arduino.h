@@ -11,9 +11,19 @@
   the definitions at the top of lcd8574arduino.c, to see typical connections
   (or edit the file if your connections are different).
 
+  A write that the expander doesn't acknowledge is reported to the
+  HD44780 class as a bus error, and nothing more is sent until the
+  caller has recovered the panel.
+
   Although both the PCF8574 and the HD44780 have data-read
   operations, this code makes no use of them. If the module's R/W pin
-  in connected, it is set permanently low, for write mode.
+  in connected, it is set permanently low, for write mode. A 40x4
+  panel, which has two controllers, needs the expander's R/W output
+  (P1) for the second enable line, E2, so the panel's R/W pin has to be
+  tied low instead.
+
+  The HD44780 command logic itself is in the HD44780 base class; this
+  class only knows how to get nibbles to the controller over I2C.
 
   Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
   GNU Public Licence, v3.0
@@ -24,15 +34,9 @@
 
 #include <inttypes.h>
 #include <Wire.h>
-#include "charactermatrix.h"
-
-// Constant for pixel size, used by the constructor. In practive, 
-//  only 5x8 seems to be used, and I think the 5x10 is only available
-//  in single-line displays
-#define LCD_5x10DOTS 0x04
-#define LCD_5x8DOTS 0x00
+#include "hd44780.h"
 
-class LCD8574Arduino : public CharacterMatrix 
+class LCD8574Arduino : public HD44780
 {
 public:
   /** LCD8574Arduino constructor -- specify the I2C address and the
@@ -40,95 +44,22 @@ public:
   LCD8574Arduino (uint8_t lcdi2c_addr,uint8_t lcdcols,uint8_t lcdrows,
     uint8_t charsize = LCD_5x8DOTS);
 
-  /* Start of methods implementing CharacterMatrix */
-
-  /** Initialze the display hardware. Call this after the constructor. 
-   *  In principle this method can fail, but we
-   *  have no real way to find out if it does.
-   */
-  void init();
-
-  /** Turn the LCD backlight on. */ 
-  void backlight_on (void);
-
-  /** Turn the LCD backlight off. */ 
-  void backlight_off (void);
-  
-  /** Clear the screen, and implicitly home the cursor. */
-  void clear();
-
-  /** Turn the display off. */
-  void display_off (void);
-
-  /** Set the cursor to blink. */
-  void blink_on (void);
-
-  /** Set the cursor not to blink. */
-  void blink_off (void);
-
-  /** Show the cursor. */
-  void cursor_on (void);
-
-  /** Hide the cursor. */
-  void cursor_off (void);
-
-  /** Ring bell. */
-  void bell (void) {}; // Not implemented
-
-  /* End of methods implementing CharacterMatrix */
-
-  /** Turn the display on. */
-  void display_on (void);
-
-  /** Use the LCD panel's logic to scroll the whole display left. */
-  void scroll_left();
-
-  /** Use the LCD panel's logic to scroll the whole display right. */
-  void scroll_right();
-
-  /** Enable left-to-right text layout (default). */ 
-  void left_to_right (void);
-
-  /** Enable right-to-left text layout (default). */ 
-  void right_to_left (void);
-
-  /** Enable the LCD display's built-in text scrolling. */
-  void autoscroll_on (void);
-
-  /** Disable the LCD display's built-in text scrolling. */
-  void autoscroll_off (void); 
-
-  /** Set the cursor position (zero-based). */
-  void set_cursor (uint8_t row, uint8_t col); 
-
-  /** Write a character at the specific location. */
-  void write_char_at (uint8_t row, uint8_t col, Char c);
-
-  /** Get number of rows, as passed to the constructor. */
-  uint8_t get_rows (void);
-
-  /** Get number of columns, as passed to the constructor. */
-  uint8_t get_cols (void);
+protected:
+  /* Start of methods implementing HD44780 */
+  void bus_init (void);
+  void write_bus (uint8_t value, uint8_t data_mode);
+  void set_backlight (uint8_t on);
+  uint8_t bus_ready (void);
+  void bus_reset (void);
+  /* End of methods implementing HD44780 */
 
 private:
   /* Note that private methods are documented in the .cpp source file */
-  void send_byte (uint8_t, uint8_t);
   void write4bits (uint8_t);
   void write_i2c_byte (uint8_t);
-  void command (uint8_t);
   void do_clock(uint8_t);
-  void write_normal_char (uint8_t c);
-  void write_form_feed (void);
-  void write_line_feed (void);
-  void write_cr (void);
 
-  uint8_t charsize; // As set in the constructor
   uint8_t i2c_addr; // As set in the constructor
-  uint8_t hardware_mode; // Lines, pixel size, etc
-  uint8_t display_mode; // Power, cursor, blink, etc
-  uint8_t text_handling_mode; // Direction, scrolling, etc
-  uint8_t cols;
-  uint8_t rows;
 
   // A value computed from the pin that is connected to the backlight
   //   LED on the panel
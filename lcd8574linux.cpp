@@ -0,0 +1,211 @@
+/*==========================================================================
+
+    lcd8574linux.cpp
+
+    Implementation of the classes that are specified in lcd8574linux.h.
+
+    Datasheet for the PCF8574:
+    https://www.ti.com/lit/ds/symlink/pcf8574.pdf
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#ifndef __AVR__
+
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "platform.h"
+
+#include "lcd8574linux.h"
+
+// The expander's pin assignment -- see lcd8574arduino.cpp for the
+//   wiring
+#define LCD_CMDDATA_FLAG 0x01
+#define LCD_ENABLE_FLAG 0x04
+#define LCD_ENABLE2_FLAG 0x02
+#define LCD_BACKLIGHT_FLAG 0x08
+
+/* =========================================================================
+       I2CDevBus
+=========================================================================*/
+
+/**
+ * I2CDevBus destructor
+ */
+I2CDevBus::~I2CDevBus()
+  {
+  if (fd >= 0) ::close (fd);
+  }
+
+/**
+ * open
+ */
+int I2CDevBus::open (const char *device)
+  {
+  fd = ::open (device, O_RDWR);
+  if (fd < 0) return errno;
+  return 0;
+  }
+
+/**
+ * write_block
+ * I2C_RDWR lets us name the slave address in each message, rather than
+ * binding the file descriptor to one address with I2C_SLAVE, so another
+ * process can use other devices on the same bus.
+ */
+int I2CDevBus::write_block (uint8_t addr, const uint8_t *buf, size_t n)
+  {
+  struct i2c_msg msg;
+  struct i2c_rdwr_ioctl_data data;
+  msg.addr = addr;
+  msg.flags = 0;
+  msg.len = n;
+  msg.buf = (uint8_t *)buf;
+  data.msgs = &msg;
+  data.nmsgs = 1;
+  if (ioctl (fd, I2C_RDWR, &data) < 0) return errno;
+  return 0;
+  }
+
+/* =========================================================================
+       FdI2CBus
+=========================================================================*/
+
+/**
+ * write_block
+ */
+int FdI2CBus::write_block (uint8_t addr, const uint8_t *buf, size_t n)
+  {
+  (void)addr;
+  while (n > 0)
+    {
+    ssize_t w = write (fd, buf, n);
+    if (w < 0)
+      {
+      if (errno == EINTR) continue;
+      return errno;
+      }
+    buf += w;
+    n -= w;
+    }
+  return 0;
+  }
+
+/* =========================================================================
+       LCD8574Linux
+=========================================================================*/
+
+/**
+ * LCD8574Linux constructor
+ */
+LCD8574Linux::LCD8574Linux (I2CBus &_bus, uint8_t lcdi2c_addr,
+    uint8_t _cols, uint8_t _rows, uint8_t charsize)
+  : HD44780 (_cols, _rows, charsize, LCD_4BITMODE),
+    bus (_bus)
+  {
+  i2c_addr = lcdi2c_addr;
+  // Turn backlight one by default -- display is useless without it
+  backlight_flag = LCD_BACKLIGHT_FLAG;
+  last = 0;
+  queued = 0;
+  error = 0;
+  }
+
+/**
+ * bus_init
+ */
+void LCD8574Linux::bus_init (void)
+  {
+  queue_byte (0);
+  flush();
+  }
+
+/**
+ * write_bus
+ * Each byte takes about 90 usec to cross a 100 kHz bus, which is
+ * longer than both the minimum enable pulse and the time the HD44780
+ * needs for an ordinary command. So, unlike LCD8574Arduino, we never
+ * need to wait between strobes. Data only has to be stable before
+ * enable falls, so the data lines can change on the same byte that
+ * raises enable; only a change of RS needs a byte of its own, before
+ * the strobe.
+ */
+void LCD8574Linux::write_bus (uint8_t value, uint8_t data_mode)
+  {
+  uint8_t v = value & 0xf0;
+  if (data_mode) v |= LCD_CMDDATA_FLAG;
+  if ((last ^ v) & LCD_CMDDATA_FLAG)
+    queue_byte (v);
+  queue_byte (v | (controller ? LCD_ENABLE2_FLAG : LCD_ENABLE_FLAG));
+  queue_byte (v);
+  }
+
+/**
+ * set_backlight
+ */
+void LCD8574Linux::set_backlight (uint8_t on)
+  {
+  if (on)
+    backlight_flag = LCD_BACKLIGHT_FLAG;
+  else
+    backlight_flag = 0;
+  queue_byte (last);
+  flush();
+  }
+
+/**
+ * bus_wait
+ * The wait only means anything once the preceding strobes have
+ * actually reached the panel.
+ */
+void LCD8574Linux::bus_wait (unsigned int us)
+  {
+  flush();
+  delayMicroseconds (us);
+  }
+
+/**
+ * flush
+ */
+void LCD8574Linux::flush (void)
+  {
+  if (queued == 0) return;
+  int e = bus.write_block (i2c_addr, queue, queued);
+  if (e)
+    {
+    error = e;
+    note_bus_error();
+    }
+  queued = 0;
+  }
+
+/**
+ * get_error
+ */
+int LCD8574Linux::get_error (void)
+  {
+  int e = error;
+  error = 0;
+  return e;
+  }
+
+/**
+ * queue_byte
+ * If the queue fills up, a strobe might get split across two
+ * transfers. That does the HD44780 no harm -- it just sees a longer
+ * gap between bytes.
+ */
+void LCD8574Linux::queue_byte (uint8_t data)
+  {
+  if (queued == sizeof (queue))
+    flush();
+  last = data;
+  queue[queued++] = data | backlight_flag;
+  }
+
+#endif
@@ -0,0 +1,112 @@
+/*============================================================================
+
+  lcd8574linux.h
+
+  Functions to control an HD44780 LCD module via a PCF8574 I2C expander,
+  from a Linux host with an I2C bus of its own (a Raspberry Pi header,
+  a spare SMBus connector, etc). The wiring of the PCF8574 is the same
+  as for LCD8574Arduino.
+
+  The PCF8574 simply presents each byte it receives on its outputs, so
+  a whole sequence of enable strobes can be sent as one multi-byte I2C
+  write. This class queues the strobes, and only hands them to the
+  kernel when the caller calls flush(), when a slow command forces a
+  wait, or when the queue is full. Writing out a row of text is then a
+  single system call.
+
+  The I2C transfer itself goes through an I2CBus object, so that
+  something other than /dev/i2c-N can stand in for the bus.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hd44780.h"
+
+// Size of the strobe queue. A 20-character row, with its address
+//   command, is about 90 bytes on the wire.
+#define LCD8574LINUX_QUEUE 512
+
+/** Something that can carry a block of bytes to an I2C device. */
+class I2CBus
+  {
+  public:
+  virtual ~I2CBus() {}
+
+  /** Write n bytes to the device at addr, as a single transfer. Returns
+   *  zero on success, or an errno value. */
+  virtual int write_block (uint8_t addr, const uint8_t *buf, size_t n) = 0;
+  };
+
+/** An I2C bus provided by the kernel's i2c-dev driver. Each block goes
+ *  out as one I2C_RDWR ioctl. */
+class I2CDevBus : public I2CBus
+  {
+  public:
+  I2CDevBus (void) : fd (-1) {}
+  ~I2CDevBus();
+
+  /** Open the bus device, e.g., /dev/i2c-1. Returns zero on success,
+   *  or an errno value. */
+  int open (const char *device);
+
+  int write_block (uint8_t addr, const uint8_t *buf, size_t n);
+
+  private:
+  int fd;
+  };
+
+/** A stand-in for an I2C bus, which just writes the bytes that would
+ *  have gone to the PCF8574 to a file descriptor -- a pipe, a file, etc.
+ *  The device address is not recorded. */
+class FdI2CBus : public I2CBus
+  {
+  public:
+  FdI2CBus (int fd) : fd (fd) {}
+
+  int write_block (uint8_t addr, const uint8_t *buf, size_t n);
+
+  private:
+  int fd;
+  };
+
+class LCD8574Linux : public HD44780
+{
+public:
+  /** LCD8574Linux constructor -- specify the bus, the I2C address, and
+      the size of the panel. */
+  LCD8574Linux (I2CBus &bus, uint8_t lcdi2c_addr, uint8_t lcdcols,
+    uint8_t lcdrows, uint8_t charsize = LCD_5x8DOTS);
+
+  /** Send anything that is queued. */
+  void flush (void);
+
+  /** Return the errno value from the last failed transfer, or zero if
+   *  there has not been one. Reading the error clears it. */
+  int get_error (void);
+
+protected:
+  /* Start of methods implementing HD44780 */
+  void bus_init (void);
+  void write_bus (uint8_t value, uint8_t data_mode);
+  void set_backlight (uint8_t on);
+  void bus_wait (unsigned int us);
+  /* End of methods implementing HD44780 */
+
+private:
+  void queue_byte (uint8_t);
+
+  I2CBus &bus;
+  uint8_t i2c_addr; // As set in the constructor
+  uint8_t backlight_flag;
+  uint8_t last; // The last byte queued, i.e., the expander's outputs
+  uint8_t queue[LCD8574LINUX_QUEUE];
+  size_t queued;
+  int error;
+};
+
@@ -0,0 +1,117 @@
+/*============================================================================
+
+  lcdfeatures.h
+
+  Compile-time switches for the optional parts of the terminal. Each is
+  either 0 (left out) or 1 (built in). The Makefile sets them according
+  to the selected PROFILE (see the comments there); anything that is
+  not set on the compiler command line gets the value below, which
+  corresponds to the "standard" profile.
+
+  Leaving out a feature saves flash and, in some cases, RAM. Run
+  "make size-report" to see what each part of the program costs.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+// Tab (9) moves to the next tab stop. Without it, tab is ignored.
+#ifndef LCDTERM_FEATURE_TABS
+#define LCDTERM_FEATURE_TABS 1
+#endif
+
+// When text runs off the bottom row, the display scrolls up. Without
+//   it, text continues from the top row instead, and the screen
+//   buffer is never read back, so nothing is ever repainted.
+#ifndef LCDTERM_FEATURE_SCROLL
+#define LCDTERM_FEATURE_SCROLL 1
+#endif
+
+// DC1-DC4 control the backlight and cursor. Without it, they are
+//   ignored.
+#ifndef LCDTERM_FEATURE_HWCONTROL
+#define LCDTERM_FEATURE_HWCONTROL 1
+#endif
+
+// Escape sequences (ESC followed by a command letter and parameters).
+//   Without this, ESC is ignored, and so are all the features that
+//   are controlled by escape sequences.
+#ifndef LCDTERM_FEATURE_ESCAPES
+#define LCDTERM_FEATURE_ESCAPES 1
+#endif
+
+// Marquee mode, for rows that hold more text than will fit. Costs about
+//   40 bytes of RAM per row, but only once marquee mode is turned on.
+#ifndef LCDTERM_FEATURE_MARQUEE
+#define LCDTERM_FEATURE_MARQUEE 1
+#endif
+
+// Screen-editing escapes: cursor addressing, clear to end of line or
+//   screen, scroll region, and filling and copying rectangles.
+#ifndef LCDTERM_FEATURE_REGIONS
+#define LCDTERM_FEATURE_REGIONS 1
+#endif
+
+// Large digits, two or three rows high, drawn with user-defined
+//   characters (ESC b). Takes over all eight of the HD44780's
+//   user-defined characters once it's used.
+#ifndef LCDTERM_FEATURE_BIGDIGITS
+#define LCDTERM_FEATURE_BIGDIGITS 1
+#endif
+
+// Blinking and inverse cells (ESC a), which the terminal animates
+//   itself. Costs rows x cols bytes of RAM, but only once used, and
+//   about 500 bytes of flash for the font that inverse cells are drawn
+//   from.
+#ifndef LCDTERM_FEATURE_ATTRIBUTES
+#define LCDTERM_FEATURE_ATTRIBUTES 1
+#endif
+
+// Urgent alerts (SOH packets), shown over one row ahead of any other
+//   input that is waiting, and a visual bell that flashes the
+//   backlight -- see alert.h.
+#ifndef LCD_FEATURE_ALERTS
+#define LCD_FEATURE_ALERTS 1
+#endif
+
+// Frame mode (ESC F): a form feed starts a frame that is held back,
+//   and then written to the panel as only the cells that differ from
+//   what is showing -- see frame.h. Costs rows x cols bytes of RAM.
+#ifndef LCD_FEATURE_FRAMES
+#define LCD_FEATURE_FRAMES 1
+#endif
+
+// A clock that the host sets once (ESC T), and that shows itself, in a
+//   format the host chooses (ESC k) -- see clock.h
+#ifndef LCD_FEATURE_CLOCK
+#define LCD_FEATURE_CLOCK 1
+#endif
+
+// Restart the panel, and redraw it, when writes to it fail, and report
+//   the number of failures and recoveries to the host (ESC ?)
+#ifndef LCD_FEATURE_RECOVERY
+#define LCD_FEATURE_RECOVERY 1
+#endif
+
+// Record events, with timestamps, in a ring in RAM, and send them to
+//   the host on request (ESC q) -- see trace.h. Costs about 400 bytes
+//   of RAM, so it's off unless needed.
+#ifndef LCD_FEATURE_TRACE
+#define LCD_FEATURE_TRACE 0
+#endif
+
+// Save the screen to EEPROM on request, or when it has been left
+//   alone for a while, and show it again at power-up.
+#ifndef LCD_FEATURE_SNAPSHOT
+#define LCD_FEATURE_SNAPSHOT 1
+#endif
+
+// Show a banner on the display until the first byte arrives from
+//   the host.
+#ifndef LCD_FEATURE_BANNER
+#define LCD_FEATURE_BANNER 1
+#endif
+
@@ -0,0 +1,122 @@
+/*==========================================================================
+
+    lcdparallel.cpp
+
+    Implementation of the class that is specified in lcdparallel.h.
+    Data and control lines are driven with direct writes to the port
+    registers, which is many times faster than going through the
+    PCF8574. Most of the time per character is now the HD44780's own
+    execution time.
+
+    Datasheet for the HD44780:
+    https://www.sparkfun.com/datasheets/LCD/HD44780.pdf
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <stdint.h>
+#include "platform.h"
+
+#include "lcdparallel.h"
+
+/**
+ * LCDParallel constructor
+ */
+LCDParallel::LCDParallel (const LCDParallelPins &_pins,
+    uint8_t _cols, uint8_t _rows, uint8_t bus_mode, uint8_t charsize)
+  : HD44780 (_cols, _rows, charsize, bus_mode),
+    pins (_pins)
+  {
+  }
+
+/**
+ * bus_init
+ * Set all the pins we use as outputs, and take them low. The backlight,
+ * if we control it, starts on -- the display is useless without it.
+ */
+void LCDParallel::bus_init (void)
+  {
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    if (pins.hi_ddr) *pins.hi_ddr |= (0x0f << pins.hi_shift);
+    *pins.hi_port &= ~(0x0f << pins.hi_shift);
+    if (bus_mode == LCD_8BITMODE)
+      {
+      if (pins.lo_ddr) *pins.lo_ddr |= (0x0f << pins.lo_shift);
+      *pins.lo_port &= ~(0x0f << pins.lo_shift);
+      }
+    uint8_t mask = pins.rs_mask | pins.e_mask | pins.e2_mask;
+    if (pins.ctrl_ddr) *pins.ctrl_ddr |= mask;
+    *pins.ctrl_port &= ~mask;
+    if (pins.bl_port)
+      {
+      if (pins.bl_ddr) *pins.bl_ddr |= pins.bl_mask;
+      *pins.bl_port |= pins.bl_mask;
+      }
+    }
+  }
+
+/**
+ * write_bus
+ * Each nibble goes out with a single read-modify-write of its port
+ * register. The Arduino core toggles the RX/TX LEDs from the USB
+ * interrupt handler, and those share ports with our pins, so the
+ * read-modify-write has to be atomic.
+ */
+void LCDParallel::write_bus (uint8_t value, uint8_t data_mode)
+  {
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    uint8_t mask = 0x0f << pins.hi_shift;
+    *pins.hi_port = (*pins.hi_port & ~mask)
+      | (((value >> 4) << pins.hi_shift) & mask);
+    if (bus_mode == LCD_8BITMODE)
+      {
+      mask = 0x0f << pins.lo_shift;
+      *pins.lo_port = (*pins.lo_port & ~mask)
+        | (((value & 0x0f) << pins.lo_shift) & mask);
+      }
+    if (data_mode)
+      *pins.ctrl_port |= pins.rs_mask;
+    else
+      *pins.ctrl_port &= ~pins.rs_mask;
+    }
+  pulse_enable (controller ? pins.e2_mask : pins.e_mask);
+  }
+
+/**
+ * set_backlight
+ */
+void LCDParallel::set_backlight (uint8_t on)
+  {
+  if (!pins.bl_port) return;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    if (on)
+      *pins.bl_port |= pins.bl_mask;
+    else
+      *pins.bl_port &= ~pins.bl_mask;
+    }
+  }
+
+/**
+ * pulse_enable
+ * The datasheet asks for an enable pulse of at least 450 nsec, and
+ * 37 usec for a typical command to complete. HD44780 shortens the
+ * wait, by way of exec_usec, when it is alternating between the two
+ * controllers of a 40x4 panel.
+ */
+void LCDParallel::pulse_enable (uint8_t e_mask)
+  {
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    *pins.ctrl_port |= e_mask;
+    }
+  delayMicroseconds (1);
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    *pins.ctrl_port &= ~e_mask;
+    }
+  delayMicroseconds (exec_usec);
+  }
+
@@ -0,0 +1,90 @@
+/*============================================================================
+
+  lcdparallel.h
+
+  Functions to control an HD44780 LCD module that is wired directly to
+  the microcontroller's GPIO pins, rather than through an I2C expander.
+  Either four (D4-D7) or eight (D0-D7) data lines can be used, along
+  with RS and E. As in LCD8574Arduino, the R/W pin is assumed to be
+  tied low.
+
+  For speed, this class does not use digitalWrite(). Instead, each group
+  of four data lines must be wired to four adjacent bits of a single
+  port, so that a nibble can be presented with one write to the port
+  register. On the Pro Micro, for example, a workable 4-bit arrangement
+  is:
+
+  D4-D7 -- A3, A2, A1, A0 (PF4-PF7)
+  RS    -- pin 8 (PB4)
+  E     -- pin 9 (PB5)
+
+  LCDParallelPins pins = { &PORTF, &DDRF, 4, 0, 0, 0,
+                           &PORTB, &DDRB, _BV(4), _BV(5), 0, 0, 0 };
+  LCDParallel lcd (pins, 20, 4);
+
+  The Pro Micro does not break out a complete 8-bit port, which is why
+  the low nibble (D0-D3) in 8-bit mode is described separately; PB1-PB4
+  (pins 15, 16, 14, 8) will do, if RS and E are moved elsewhere.
+
+  A 40x4 panel has two controllers, and a second enable line, E2, for
+  the bottom two rows. It must be on the same port as RS and E; pin 10
+  (PB6) will do, with e2_mask set to _BV(6).
+
+  Because the port registers are reached through pointers, the same
+  class can be pointed at ordinary variables on a host, which is what
+  LCDParallelEmulated does.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "hd44780.h"
+
+/** Describes where the panel is connected. Pointers to the DDR registers
+ *  may be null if the caller has already set the pins as outputs. */
+struct LCDParallelPins
+  {
+  volatile uint8_t *hi_port;  // PORTx register for D4-D7
+  volatile uint8_t *hi_ddr;   // DDRx register for D4-D7
+  uint8_t hi_shift;           // Bit number of D4 within the port (0-4)
+  volatile uint8_t *lo_port;  // PORTx register for D0-D3, 8-bit mode only
+  volatile uint8_t *lo_ddr;   // DDRx register for D0-D3
+  uint8_t lo_shift;           // Bit number of D0 within the port (0-4)
+  volatile uint8_t *ctrl_port; // PORTx register for RS and E
+  volatile uint8_t *ctrl_ddr;  // DDRx register for RS and E
+  uint8_t rs_mask;            // Bit mask for RS within ctrl_port
+  uint8_t e_mask;             // Bit mask for E within ctrl_port
+  volatile uint8_t *bl_port;  // PORTx register for backlight; may be null
+  volatile uint8_t *bl_ddr;   // DDRx register for backlight
+  uint8_t bl_mask;            // Bit mask for backlight within bl_port
+  uint8_t e2_mask;            // Bit mask for E2 within ctrl_port, 40x4 only
+  };
+
+class LCDParallel : public HD44780
+{
+public:
+  /** LCDParallel constructor -- specify the wiring, the size of the
+      panel, and whether four or eight data lines are connected. */
+  LCDParallel (const LCDParallelPins &pins, uint8_t lcdcols,
+    uint8_t lcdrows, uint8_t bus_mode = LCD_4BITMODE,
+    uint8_t charsize = LCD_5x8DOTS);
+
+protected:
+  /* Start of methods implementing HD44780 */
+  void bus_init (void);
+  void write_bus (uint8_t value, uint8_t data_mode);
+  void set_backlight (uint8_t on);
+  /* End of methods implementing HD44780 */
+
+  /** Strobe the enable line given by e_mask, and wait for the
+   *  controller to act on what it has latched. Virtual only so that
+   *  LCDParallelEmulated can watch the strobes. */
+  virtual void pulse_enable (uint8_t e_mask);
+
+  LCDParallelPins pins;
+};
+
@@ -0,0 +1,233 @@
+/*==========================================================================
+
+    lcdparallelemu.cpp
+
+    Implementation of the class that is specified in lcdparallelemu.h.
+    The emulated controller decodes whatever is on the emulated ports
+    each time the driver strobes the enable line, in the same way as
+    a real HD44780 latches its inputs on the falling edge of E.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#ifndef __AVR__
+
+#include <stdio.h>
+#include <string.h>
+#include "lcdparallelemu.h"
+
+// Where the emulated lines sit within the emulated ports
+#define EMU_RS_MASK 0x01
+#define EMU_E_MASK  0x02
+#define EMU_E2_MASK 0x04
+#define EMU_BL_MASK 0x01
+
+/**
+ * make_pins
+ * Build a pin description that points at our own emulated registers.
+ * This is called before the members are initialized, but only their
+ * addresses are needed at this stage.
+ */
+LCDParallelPins LCDParallelEmulated::make_pins (LCDParallelEmulated *self)
+  {
+  LCDParallelPins p;
+  p.hi_port = &self->port_hi;
+  p.hi_ddr = 0;
+  p.hi_shift = 4;
+  p.lo_port = &self->port_lo;
+  p.lo_ddr = 0;
+  p.lo_shift = 0;
+  p.ctrl_port = &self->port_ctrl;
+  p.ctrl_ddr = 0;
+  p.rs_mask = EMU_RS_MASK;
+  p.e_mask = EMU_E_MASK;
+  p.bl_port = &self->port_bl;
+  p.bl_ddr = 0;
+  p.bl_mask = EMU_BL_MASK;
+  p.e2_mask = EMU_E2_MASK;
+  return p;
+  }
+
+/**
+ * LCDParallelEmulated constructor
+ * The controller starts in the state the datasheet gives for power-on:
+ * 8-bit interface, one line, display blank (all spaces).
+ */
+LCDParallelEmulated::LCDParallelEmulated (uint8_t _cols, uint8_t _rows,
+    uint8_t bus_mode)
+  : LCDParallel (make_pins (this), _cols, _rows, bus_mode)
+  {
+  port_hi = port_lo = port_ctrl = port_bl = 0;
+  for (int i = 0; i < 2; i++)
+    {
+    Controller *ctl = &ctls[i];
+    memset (ctl->ddram, ' ', sizeof (ctl->ddram));
+    memset (ctl->cgram, 0, sizeof (ctl->cgram));
+    ctl->address = 0;
+    ctl->in_cgram = 0;
+    ctl->eight_bit = 1;
+    ctl->two_line = 0;
+    ctl->have_nibble = 0;
+    ctl->nibble = 0;
+    ctl->entry_mode = 0x02;
+    ctl->shift = 0;
+    }
+  strobes = 0;
+  }
+
+/**
+ * get_visible_char
+ * In two-line mode each line of DDRAM is 40 cells long, and the
+ * display shift rotates each line independently. Panels with four rows
+ * are really two long lines, folded, so rows 2 and 3 are the second
+ * halves of rows 0 and 1 -- unless there are two controllers, in
+ * which case rows 2 and 3 are rows 0 and 1 of the second.
+ */
+Char LCDParallelEmulated::get_visible_char (uint8_t row, uint8_t col)
+  {
+  const Controller *ctl = &ctls[0];
+  if (controllers > 1)
+    {
+    ctl = &ctls[row >> 1];
+    row &= 1;
+    }
+  int pos;
+  if (ctl->two_line)
+    {
+    pos = (row >> 1) * cols + col + ctl->shift;
+    pos = ((pos % 40) + 40) % 40;
+    return ctl->ddram[(row & 1) ? 0x40 + pos : pos];
+    }
+  pos = row * cols + col + ctl->shift;
+  return ctl->ddram[((pos % 80) + 80) % 80];
+  }
+
+/**
+ * dump
+ */
+void LCDParallelEmulated::dump (FILE *f)
+  {
+  for (uint8_t row = 0; row < rows; row++)
+    {
+    fputc ('|', f);
+    for (uint8_t col = 0; col < cols; col++)
+      {
+      Char c = get_visible_char (row, col);
+      // CGRAM characters have no meaningful printable form
+      fputc (c < 16 ? '#' : c, f);
+      }
+    fputs ("|\n", f);
+    }
+  }
+
+/**
+ * pulse_enable
+ * Latch the emulated data and RS lines into whichever controller's
+ * enable line was strobed. A panel wired for four data lines sees
+ * nothing on D0-D3, which we model as zeros.
+ */
+void LCDParallelEmulated::pulse_enable (uint8_t e_mask)
+  {
+  strobes++;
+  Controller *ctl = &ctls[e_mask == EMU_E2_MASK ? 1 : 0];
+  uint8_t rs = (port_ctrl & EMU_RS_MASK) != 0;
+  uint8_t hi = (port_hi >> 4) & 0x0f;
+  uint8_t lo = 0;
+  if (bus_mode == LCD_8BITMODE)
+    lo = port_lo & 0x0f;
+
+  if (ctl->eight_bit)
+    {
+    execute (ctl, (hi << 4) | lo, rs);
+    }
+  else if (!ctl->have_nibble)
+    {
+    ctl->nibble = hi;
+    ctl->have_nibble = 1;
+    }
+  else
+    {
+    ctl->have_nibble = 0;
+    execute (ctl, (ctl->nibble << 4) | hi, rs);
+    }
+  }
+
+/**
+ * execute
+ * Act on a complete byte, as the HD44780 would.
+ */
+void LCDParallelEmulated::execute (Controller *ctl, uint8_t value,
+    uint8_t rs)
+  {
+  int8_t step = (ctl->entry_mode & 0x02) ? 1 : -1;
+
+  if (rs)
+    {
+    if (ctl->in_cgram)
+      {
+      ctl->cgram[ctl->address & 0x3f] = value;
+      ctl->address = (ctl->address + step) & 0x3f;
+      return;
+      }
+    ctl->ddram[ctl->address & 0x7f] = value;
+    if (ctl->two_line)
+      {
+      uint8_t base = ctl->address & 0x40;
+      uint8_t pos = ((ctl->address & 0x3f) + 40 + step) % 40;
+      ctl->address = base | pos;
+      }
+    else
+      ctl->address = (ctl->address + 80 + step) % 80;
+    if (ctl->entry_mode & 0x01)
+      ctl->shift += step;
+    return;
+    }
+
+  if (value & 0x80)
+    {
+    ctl->address = value & 0x7f;
+    ctl->in_cgram = 0;
+    }
+  else if (value & 0x40)
+    {
+    ctl->address = value & 0x3f;
+    ctl->in_cgram = 1;
+    }
+  else if (value & 0x20)
+    {
+    ctl->eight_bit = (value & 0x10) != 0;
+    ctl->two_line = (value & 0x08) != 0;
+    ctl->have_nibble = 0;
+    }
+  else if (value & 0x10)
+    {
+    if (value & 0x08)
+      ctl->shift += (value & 0x04) ? -1 : 1;
+    else
+      ctl->address += (value & 0x04) ? 1 : -1;
+    }
+  else if (value & 0x08)
+    {
+    // Display on/off, cursor, blink -- nothing visible to model
+    }
+  else if (value & 0x04)
+    {
+    ctl->entry_mode = value & 0x03;
+    }
+  else if (value & 0x02)
+    {
+    ctl->address = 0;
+    ctl->in_cgram = 0;
+    ctl->shift = 0;
+    }
+  else if (value & 0x01)
+    {
+    memset (ctl->ddram, ' ', sizeof (ctl->ddram));
+    ctl->address = 0;
+    ctl->in_cgram = 0;
+    ctl->shift = 0;
+    ctl->entry_mode |= 0x02;
+    }
+  }
+
+#endif
@@ -0,0 +1,79 @@
+/*============================================================================
+
+  lcdparallelemu.h
+
+  A version of LCDParallel whose "port registers" are ordinary variables,
+  with a simple model of the HD44780 watching the enable strobes. This
+  lets the parallel driver, and LCDTerm on top of it, be run and checked
+  on a Linux host. It is not part of the firmware build.
+
+  The model is only as deep as the driver needs: it tracks the interface
+  width, the DDRAM and CGRAM contents, the address counter, the entry
+  mode and the display shift. It has no timing model, and does not
+  check that the driver waits long enough between commands. A panel
+  of more than 80 cells is modelled as two controllers, on separate
+  enable lines, as on a real 40x4.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "lcdparallel.h"
+
+class LCDParallelEmulated : public LCDParallel
+{
+public:
+  LCDParallelEmulated (uint8_t lcdcols, uint8_t lcdrows,
+    uint8_t bus_mode = LCD_4BITMODE);
+
+  /** Return the character that the panel is showing at the given
+   *  position, taking account of the display shift. */
+  Char get_visible_char (uint8_t row, uint8_t col);
+
+  /** Return the number of enable strobes seen since construction. */
+  unsigned long get_strobes (void) { return strobes; }
+
+  /** Return the state of the backlight pin. */
+  uint8_t get_backlight (void) { return (port_bl & 1) != 0; }
+
+  /** Print the visible contents of the panel, one row per line. */
+  void dump (FILE *f);
+
+protected:
+  void pulse_enable (uint8_t e_mask);
+
+private:
+  /** The state of one emulated controller */
+  struct Controller
+    {
+    uint8_t ddram[128];
+    uint8_t cgram[64];
+    uint8_t address;      // Address counter
+    uint8_t in_cgram;     // Last address set was a CGRAM address
+    uint8_t eight_bit;    // Interface is in 8-bit mode
+    uint8_t two_line;     // Function set selected two-line addressing
+    uint8_t have_nibble;  // First half of a 4-bit transfer has arrived
+    uint8_t nibble;       // ...and this is it
+    uint8_t entry_mode;
+    int8_t shift;         // Display shift, in cells
+    };
+
+  static LCDParallelPins make_pins (LCDParallelEmulated *self);
+  void execute (Controller *ctl, uint8_t value, uint8_t rs);
+
+  // The emulated port registers
+  volatile uint8_t port_hi;
+  volatile uint8_t port_lo;
+  volatile uint8_t port_ctrl;
+  volatile uint8_t port_bl;
+
+  // The emulated controllers -- the second is used only by a 40x4
+  Controller ctls[2];
+  unsigned long strobes;
+};
+
@@ -4,9 +4,147 @@ Kevin Boone, January 2021
 
 */
 
-#include <Arduino.h>
+#include "platform.h"
 #include "lcdterm.h" 
 #include "charactermatrix.h" 
+#include "trace.h" 
+#if LCDTERM_FEATURE_ATTRIBUTES
+#include "font5x7.h"
+#endif
+
+// States of the escape sequence parser
+#define ESC_NONE    0 // Not in an escape sequence
+#define ESC_COMMAND 1 // ESC received, waiting for the command
+#define ESC_PARAMS  2 // Collecting parameters
+
+// Index of DEL in the control code table
+#define CTRL_DEL (LCDTERM_CTRL_CODES - 1)
+
+// stale_top when no rows are waiting to be repainted
+#define STALE_NONE 0xFF
+
+#if LCDTERM_FEATURE_ATTRIBUTES
+// inverse_slot() has no user-defined character to give
+#define INVERSE_NONE 0xFF
+// Solid block, from the character ROM -- an inverted blank
+#define INVERSE_BLANK 0xFF
+// The widest row that write_cells() will build -- the widest HD44780
+//   panel
+#define ATTR_MAX_WIDTH 40
+#endif
+
+#if LCDTERM_FEATURE_BIGDIGITS
+
+// The segments that big digits are made of, as user-defined
+//   characters 8-15 -- the same as 0-7, but without the zero, which
+//   means an empty cell
+#define BIG_LT   8  // Left side, with the top corner rounded
+#define BIG_UB   9  // Bar across the top
+#define BIG_RT  10  // Right side, with the top corner rounded
+#define BIG_LL  11  // Left side, with the bottom corner rounded
+#define BIG_LB  12  // Bar across the bottom
+#define BIG_LR  13  // Right side, with the bottom corner rounded
+#define BIG_UMB 14  // Bars across the top and bottom
+#define BIG_LMB 15  // Thin bar across the top, thick across the bottom
+#define BIG_FUL 0xFF // Solid block, from the character ROM
+#define BIG_DOT 0xA5 // Centred dot, from the character ROM
+#define BIG____ 0   // Blank
+
+static const uint8_t big_segments[8][8] PROGMEM =
+  {
+  { 0x07, 0x0F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F }, // LT
+  { 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00 }, // UB
+  { 0x1C, 0x1E, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F }, // RT
+  { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x0F, 0x07 }, // LL
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F }, // LB
+  { 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1E, 0x1C }, // LR
+  { 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x1F, 0x1F }, // UMB
+  { 0x1F, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F }  // LMB
+  };
+
+// Digits two rows high, three cells per row
+static const uint8_t big_digits2[10][6] PROGMEM =
+  {
+  { BIG_LT,  BIG_UB,  BIG_RT,  BIG_LL,  BIG_LB,  BIG_LR  }, // 0
+  { BIG_UB,  BIG_RT,  BIG____, BIG_LB,  BIG_FUL, BIG_LB  }, // 1
+  { BIG_UMB, BIG_UMB, BIG_RT,  BIG_LL,  BIG_LMB, BIG_LMB }, // 2
+  { BIG_UMB, BIG_UMB, BIG_RT,  BIG_LMB, BIG_LMB, BIG_LR  }, // 3
+  { BIG_LL,  BIG_LB,  BIG_FUL, BIG____, BIG____, BIG_FUL }, // 4
+  { BIG_FUL, BIG_UMB, BIG_UMB, BIG_LMB, BIG_LMB, BIG_LR  }, // 5
+  { BIG_LT,  BIG_UMB, BIG_UMB, BIG_LL,  BIG_LMB, BIG_LR  }, // 6
+  { BIG_UB,  BIG_UB,  BIG_RT,  BIG____, BIG____, BIG_FUL }, // 7
+  { BIG_LT,  BIG_UMB, BIG_RT,  BIG_LL,  BIG_LMB, BIG_LR  }, // 8
+  { BIG_LT,  BIG_UMB, BIG_RT,  BIG_LB,  BIG_LB,  BIG_LR  }  // 9
+  };
+
+// Digits three rows high
+static const uint8_t big_digits3[10][9] PROGMEM =
+  {
+  { BIG_LT,  BIG_UB,  BIG_RT,  BIG_FUL, BIG____, BIG_FUL,
+    BIG_LL,  BIG_LB,  BIG_LR  }, // 0
+  { BIG_UB,  BIG_RT,  BIG____, BIG____, BIG_FUL, BIG____,
+    BIG_LB,  BIG_FUL, BIG_LB  }, // 1
+  { BIG_UB,  BIG_UB,  BIG_RT,  BIG_LB,  BIG_LB,  BIG_LR,
+    BIG_FUL, BIG_LB,  BIG_LB  }, // 2
+  { BIG_UB,  BIG_UB,  BIG_RT,  BIG_LB,  BIG_LB,  BIG_FUL,
+    BIG_LB,  BIG_LB,  BIG_LR  }, // 3
+  { BIG_FUL, BIG____, BIG_FUL, BIG_LL,  BIG_LB,  BIG_FUL,
+    BIG____, BIG____, BIG_FUL }, // 4
+  { BIG_FUL, BIG_UB,  BIG_UB,  BIG_LL,  BIG_LB,  BIG_LB,
+    BIG_LB,  BIG_LB,  BIG_LR  }, // 5
+  { BIG_LT,  BIG_UB,  BIG_UB,  BIG_FUL, BIG_LB,  BIG_LB,
+    BIG_LL,  BIG_LB,  BIG_LR  }, // 6
+  { BIG_UB,  BIG_UB,  BIG_RT,  BIG____, BIG____, BIG_FUL,
+    BIG____, BIG____, BIG_FUL }, // 7
+  { BIG_LT,  BIG_UB,  BIG_RT,  BIG_FUL, BIG_LB,  BIG_FUL,
+    BIG_LL,  BIG_LB,  BIG_LR  }, // 8
+  { BIG_LT,  BIG_UB,  BIG_RT,  BIG_LL,  BIG_LB,  BIG_FUL,
+    BIG_LB,  BIG_LB,  BIG_LR  }  // 9
+  };
+
+// The widest row of big text we'll build -- the widest HD44780 panel
+#define BIG_MAX_WIDTH 40
+
+#endif
+
+// The control code actions that reset_controls() starts from. Codes
+//   that have no particular meaning are ignored.
+static const uint8_t default_controls[LCDTERM_CTRL_CODES] PROGMEM =
+  {
+  LCDTERM_ACT_IGNORE,        // 0  NUL
+  LCDTERM_ACT_IGNORE,        // 1
+  LCDTERM_ACT_IGNORE,        // 2
+  LCDTERM_ACT_IGNORE,        // 3
+  LCDTERM_ACT_IGNORE,        // 4
+  LCDTERM_ACT_IGNORE,        // 5
+  LCDTERM_ACT_IGNORE,        // 6
+  LCDTERM_ACT_BELL,          // 7  BEL
+  LCDTERM_ACT_BS,            // 8  BS
+  LCDTERM_ACT_TAB,           // 9  HT
+  LCDTERM_ACT_LF,            // 10 LF
+  LCDTERM_ACT_IGNORE,        // 11
+  LCDTERM_ACT_FF,            // 12 FF
+  LCDTERM_ACT_CR,            // 13 CR
+  LCDTERM_ACT_WRAP_OFF,      // 14 SO
+  LCDTERM_ACT_WRAP_ON,       // 15 SI
+  LCDTERM_ACT_IGNORE,        // 16
+  LCDTERM_ACT_BACKLIGHT_OFF, // 17 DC1
+  LCDTERM_ACT_BACKLIGHT_ON,  // 18 DC2
+  LCDTERM_ACT_CURSOR_OFF,    // 19 DC3
+  LCDTERM_ACT_CURSOR_ON,     // 20 DC4
+  LCDTERM_ACT_IGNORE,        // 21
+  LCDTERM_ACT_IGNORE,        // 22
+  LCDTERM_ACT_IGNORE,        // 23
+  LCDTERM_ACT_IGNORE,        // 24
+  LCDTERM_ACT_IGNORE,        // 25
+  LCDTERM_ACT_IGNORE,        // 26
+  LCDTERM_ACT_IGNORE,        // 27 ESC, if escapes are not built in
+  LCDTERM_ACT_IGNORE,        // 28
+  LCDTERM_ACT_IGNORE,        // 29
+  LCDTERM_ACT_IGNORE,        // 30
+  LCDTERM_ACT_IGNORE,        // 31
+  LCDTERM_ACT_DEL            // 127 DEL
+  };
 
 LCDTerm::LCDTerm (CharacterMatrix &cm, uint8_t flags) : 
     cm (cm),
@@ -14,14 +152,62 @@ LCDTerm::LCDTerm (CharacterMatrix &cm, uint8_t flags) :
     current_col (0),
     lf_is_crlf (false),
     swap_bs_del (false),
+    no_wrap (false),
     tab_space (5)
   {
   rows = cm.get_rows();
   cols = cm.get_cols();
-  if (flags && LCDTERM_LF_IS_CRLF)
+  curr_buff = NULL;
+  scroll_top = 0;
+  scroll_bottom = rows - 1;
+  stale_top = STALE_NONE;
+  stale_bottom = 0;
+#if LCDTERM_FEATURE_ESCAPES
+  esc_state = ESC_NONE;
+  esc_handler = NULL;
+#endif
+#if LCDTERM_FEATURE_MARQUEE
+  marquee_mode = LCDTERM_MARQUEE_OFF;
+  marquee_hw = 0;
+  marquee_interval = LCDTERM_MARQUEE_INTERVAL;
+  marquee_step = 0;
+  marquee_last = 0;
+  marquee_buff = NULL;
+  marquee_len = NULL;
+#endif
+#if LCDTERM_FEATURE_BIGDIGITS
+  big_loaded = false;
+#endif
+#if LCDTERM_FEATURE_ATTRIBUTES
+  attr_buff = NULL;
+  curr_attr = LCDTERM_ATTR_NONE;
+  blink_off = false;
+  blink_last = 0;
+  memset (inv_chars, 0, sizeof (inv_chars));
+#endif
+  if (flags & LCDTERM_LF_IS_CRLF)
     lf_is_crlf = true;
-  if (flags && LCDTERM_SWAP_BS_DEL)
+  if (flags & LCDTERM_SWAP_BS_DEL)
     swap_bs_del = true;
+  if (flags & LCDTERM_NO_WRAP)
+    no_wrap = true;
+  reset_controls();
+  }
+
+/**
+ * LCDTerm destructor
+ * The firmware never gets rid of its terminal, but a host program
+ * might.
+ */
+LCDTerm::~LCDTerm()
+  {
+  free (curr_buff);
+#if LCDTERM_FEATURE_MARQUEE
+  free (marquee_buff);
+#endif
+#if LCDTERM_FEATURE_ATTRIBUTES
+  free (attr_buff);
+#endif
   }
 
 /**
@@ -64,58 +250,135 @@ void LCDTerm::set_cursor (uint8_t row, uint8_t col)
  */
 void LCDTerm::print (Char c)
   {
+#if LCDTERM_FEATURE_ESCAPES
+  if (esc_state != ESC_NONE)
+    {
+    parse_escape (c);
+    return;
+    }
+  if (c == 27)
+    {
+    esc_state = ESC_COMMAND;
+    return;
+    }
+#endif
   print_nonescape_char (c);
   }
 
 /**
- * print (char)
+ * print_nonescape_char
+ * Anything that isn't a control code goes straight to the display;
+ * control codes are looked up in the table.
  */
 void LCDTerm::print_nonescape_char (Char c)
   {
-  switch (c)
+  if (c >= 32 && c != 127)
+    {
+    print_normal_char (c);
+    return;
+    }
+  do_control (c, controls[c == 127 ? CTRL_DEL : c]);
+  }
+
+/**
+ * do_control
+ * Carry out a control code action. The cases are numbered
+ * consecutively, so the compiler can make a jump table of them.
+ */
+void LCDTerm::do_control (Char c, uint8_t action)
+  {
+  switch (action)
     {
-    case 0:; // Do nothing
-    case 7:  // Ring bell
+    case LCDTERM_ACT_PRINT:
+      print_normal_char (c);
+      break;
+    case LCDTERM_ACT_BELL:
       print_bell();
       break;
-    case 8:  // Backspace
-      if (swap_bs_del)
-        print_del();
-      else
-        print_bs();
+    case LCDTERM_ACT_BS:
+      print_bs();
+      break;
+    case LCDTERM_ACT_DEL:
+      print_del();
+      break;
+#if LCDTERM_FEATURE_TABS
+    case LCDTERM_ACT_TAB:
+      print_tab();
       break;
-    case 9:  // Tab
-      print_tab ();
+#endif
+    case LCDTERM_ACT_CRLF:
+      current_col = 0;
+      // Fall through
+    case LCDTERM_ACT_LF:
+      advance_row();
+      cm.set_cursor (current_row, current_col);
       break;
-    case 10: // Line feed
-      print_line_feed ();
+    case LCDTERM_ACT_CR:
+      print_cr();
       break;
-    case 12: // Form feed
-      print_form_feed ();
+    case LCDTERM_ACT_FF:
+      print_form_feed();
       break;
-    case 13: // Carriage return
-      print_cr ();
+    case LCDTERM_ACT_HOME:
+      home();
       break;
-    case 17: // DC1 
+#if LCDTERM_FEATURE_HWCONTROL
+    case LCDTERM_ACT_BACKLIGHT_OFF:
       cm.backlight_off();
       break;
-    case 18: // DC2 
+    case LCDTERM_ACT_BACKLIGHT_ON:
       cm.backlight_on();
       break;
-    case 19: // DC3 
+    case LCDTERM_ACT_CURSOR_OFF:
       cm.cursor_off();
       break;
-    case 20: // DC3 
+    case LCDTERM_ACT_CURSOR_ON:
       cm.cursor_on();
       break;
-    case 127: // Del
-      if (swap_bs_del)
-        print_bs();
-      else
-        print_del();
+#endif
+    case LCDTERM_ACT_WRAP_OFF:
+      set_wrap (false);
+      break;
+    case LCDTERM_ACT_WRAP_ON:
+      set_wrap (true);
       break;
-    default:
-      print_normal_char (c);
+    }
+  }
+
+/**
+ * set_control
+ */
+void LCDTerm::set_control (Char code, uint8_t action)
+  {
+  if (action > LCDTERM_ACT_MAX) return;
+  if (code == 127)
+    controls[CTRL_DEL] = action;
+  else if (code < 32)
+    controls[code] = action;
+  }
+
+/**
+ * get_control
+ */
+uint8_t LCDTerm::get_control (Char code)
+  {
+  if (code == 127) return controls[CTRL_DEL];
+  if (code < 32) return controls[code];
+  return LCDTERM_ACT_PRINT;
+  }
+
+/**
+ * reset_controls
+ */
+void LCDTerm::reset_controls (void)
+  {
+  memcpy_P (controls, default_controls, LCDTERM_CTRL_CODES);
+  if (lf_is_crlf)
+    controls[10] = LCDTERM_ACT_CRLF;
+  if (swap_bs_del)
+    {
+    controls[8] = LCDTERM_ACT_DEL;
+    controls[CTRL_DEL] = LCDTERM_ACT_BS;
     }
   }
 
@@ -137,10 +400,7 @@ void LCDTerm::print (const Char *s)
 void LCDTerm::print_line_feed (void)
   {
   if (lf_is_crlf) print_cr();
-  if (current_row < rows - 1)
-    current_row++;
-  else
-    scroll_up ();
+  advance_row ();
   cm.set_cursor (current_row, current_col);
   }
 
@@ -149,8 +409,12 @@ void LCDTerm::print_line_feed (void)
  */
 void LCDTerm::print_form_feed (void)
   {
+  TRACE (TRACE_CLEAR, 0);
   cm.clear();
   clear_buff();
+#if LCDTERM_FEATURE_MARQUEE
+  marquee_clear();
+#endif
   current_row = 0;
   current_col = 0;
   }
@@ -166,20 +430,46 @@ void LCDTerm::print_cr (void)
 
 /**
  * print_normal_char
+ * Without wrapping, the column is left just past the end of the row,
+ * and everything else is ignored until the next CR or LF. The cursor
+ * stays on the last cell, because the HD44780 would otherwise show it
+ * at whatever address follows, which may be on another row.
  */
 void LCDTerm::print_normal_char (Char c)
   {
+#if LCDTERM_FEATURE_MARQUEE
+  if (marquee_mode != LCDTERM_MARQUEE_OFF)
+    {
+    marquee_char (c);
+    return;
+    }
+#endif
   if (current_row < rows)
     {
-    curr_buff [current_row * cols + current_col] = c;
-    cm.write_char_at (current_row, current_col, c);
+    if (current_col >= cols)
+      {
+      // Only if wrapping has been turned back on since the row filled
+      if (no_wrap) return;
+      advance_row();
+      current_col = 0;
+      }
+    uint16_t i = current_row * cols + current_col;
+    curr_buff [i] = c;
+#if LCDTERM_FEATURE_ATTRIBUTES
+    if (attr_buff) attr_buff [i] = curr_attr;
+#endif
+    // A row that has scrolled will be repainted anyway
+    if (!is_stale (current_row))
+      cm.write_char_at (current_row, current_col, cell (i));
     current_col++;
     if (current_col >= cols)
       {
-      if (current_row >= rows - 1)
-        scroll_up();
-      else
-        current_row++;
+      if (no_wrap)
+        {
+        cm.set_cursor (current_row, cols - 1);
+        return;
+        }
+      advance_row();
       current_col = 0;
       cm.set_cursor (current_row, current_col);
       }
@@ -228,43 +518,308 @@ void LCDTerm::backlight_off (void)
  */
 void LCDTerm::clear (void)
   {
+  TRACE (TRACE_CLEAR, 0);
   cm.clear();
   clear_buff();
+#if LCDTERM_FEATURE_MARQUEE
+  marquee_clear();
+#endif
   home();
   }
 
 /** dump_buff */
 void LCDTerm::buff_to_display (void)
   {
+  TRACE (TRACE_FLUSH_START, 0);
+  stale_top = STALE_NONE;
+  stale_bottom = 0;
   cm.clear();
-  for (uint8_t row = 0; row < rows; row++)
+  write_cells (0, 0, rows, cols);
+  TRACE (TRACE_FLUSH_END, 0);
+  }
+
+/**
+ * paint_rect
+ * Copy part of the screen buffer to the display. The caller is
+ * responsible for clipping, and for putting the cursor back.
+ */
+void LCDTerm::paint_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w)
+  {
+  TRACE (TRACE_FLUSH_START, h);
+  write_cells (row, col, h, w);
+  TRACE (TRACE_FLUSH_END, h);
+  }
+
+/**
+ * write_cells
+ * Write part of the screen buffer to the display, as it should look.
+ * A cell with attributes might not show what is in the buffer, so if
+ * there are any, each row is built up, and written, on its own.
+ */
+void LCDTerm::write_cells (uint8_t row, uint8_t col, uint8_t h, uint8_t w)
+  {
+#if LCDTERM_FEATURE_ATTRIBUTES
+  bool plain = true;
+  for (uint8_t r = 0; attr_buff && plain && r < h; r++)
+    for (uint8_t c = 0; plain && c < w; c++)
+      if (attr_buff[(row + r) * cols + col + c]) plain = false;
+  if (!plain)
     {
-    for (uint8_t col = 0; col < cols; col++)
+    if (w > ATTR_MAX_WIDTH) w = ATTR_MAX_WIDTH;
+    for (uint8_t r = 0; r < h; r++)
       {
-      cm.write_char_at (row, col, curr_buff[row * col_stride + col]);
+      // Any inverted characters are defined before the row is written,
+      //   because defining one moves the controller's address
+      Char line[ATTR_MAX_WIDTH];
+      uint16_t i = (row + r) * cols + col;
+      for (uint8_t c = 0; c < w; c++)
+        line[c] = cell (i + c);
+      cm.write_run (row + r, col, line, w);
       }
+    return;
     }
+#endif
+  cm.write_rect (row, col, h, w, curr_buff + row * col_stride + col,
+    col_stride);
+  }
+
+/**
+ * update_cells
+ * Put n characters into the screen buffer, starting at row, col, and
+ * write the ones that have changed to the display, in runs. The caller
+ * is responsible for clipping, and for putting the cursor back, if
+ * this returns true to say that anything was written.
+ */
+bool LCDTerm::update_cells (uint8_t row, uint8_t col, const Char *s,
+    uint8_t n)
+  {
+  Char *line = curr_buff + row * col_stride + col;
+  bool changed = false;
+  int16_t run_start = -1;
+  for (uint8_t i = 0; i <= n; i++)
+    {
+    if (i < n && line[i] != s[i])
+      {
+      line[i] = s[i];
+      if (run_start < 0) run_start = i;
+      }
+    else if (run_start >= 0)
+      {
+      write_cells (row, col + run_start, 1, i - run_start);
+      run_start = -1;
+      changed = true;
+      }
+    }
+  return changed;
+  }
+
+/**
+ * put_text
+ */
+void LCDTerm::put_text (uint8_t row, uint8_t col, const Char *s, uint8_t n)
+  {
+  if (row >= rows || col >= cols) return;
+  if (n > cols - col) n = cols - col;
+  if (update_cells (row, col, s, n))
+    cm.set_cursor (current_row, current_col);
+  }
+
+/**
+ * advance_row
+ * Move the cursor down a row, scrolling if it is already on the
+ * bottom row of the scroll region. If scrolling is not built in, go
+ * back to the top of the region. A row that was being clipped isn't
+ * any more, so the column comes back onto the display -- a bare line
+ * feed keeps it, and the cursor must not be left past the end of the
+ * row.
+ */
+void LCDTerm::advance_row (void)
+  {
+  if (current_col >= cols) current_col = cols - 1;
+  if (current_row == scroll_bottom)
+#if LCDTERM_FEATURE_SCROLL
+    scroll_up ();
+#else
+    current_row = scroll_top;
+#endif
+  else if (current_row < rows - 1)
+    current_row++;
+  }
+
+/**
+ * repaint
+ */
+void LCDTerm::repaint (void)
+  {
+#if LCDTERM_FEATURE_BIGDIGITS
+  // The buffer might have come from a snapshot, saved before the power
+  //   went, and the segments with it
+  for (uint16_t i = 0; !big_loaded && i < rows * col_stride; i++)
+    if (curr_buff[i] >= BIG_LT && curr_buff[i] <= BIG_LMB) big_load();
+#endif
+  buff_to_display();
+#if LCDTERM_FEATURE_MARQUEE
+  marquee_repaint();
+#endif
+  cm.set_cursor (current_row, current_col);
+  }
+
+/**
+ * panel_reset
+ */
+void LCDTerm::panel_reset (void)
+  {
+  cm.panel_reset();
+#if LCDTERM_FEATURE_BIGDIGITS
+  big_loaded = false;
+#endif
+#if LCDTERM_FEATURE_ATTRIBUTES
+  memset (inv_chars, 0, sizeof (inv_chars));
+#endif
+  repaint();
   }
 
 /**
  * scroll_up
+ * Only the buffer is scrolled here. The rows in the scroll region are
+ * marked stale, and rewritten by flush(), without clearing the display
+ * first, which on the HD44780 is slow. A burst of line feeds then costs
+ * one repaint, rather than one per line, and lines that scroll off
+ * before the flush never reach the display at all. In hardware marquee
+ * mode, though, the display is cleared and repainted straight away,
+ * because that is the only way to put the display shift back where the
+ * text expects it to be.
  */
 void LCDTerm::scroll_up (void)
   {
+  TRACE (TRACE_SCROLL, scroll_top);
+  uint8_t n = scroll_bottom - scroll_top;
+  Char *top = curr_buff + scroll_top * col_stride;
   // Shift up the buffer
-  memmove (curr_buff, curr_buff + col_stride, (rows - 1) * col_stride);
+  memmove (top, top + col_stride, n * col_stride);
   // Null the bottom line (nulls will print as spaces)
-  memset (curr_buff + (rows - 1) * col_stride, 0, col_stride);
-  buff_to_display();
+  memset (top + n * col_stride, 0, col_stride);
+#if LCDTERM_FEATURE_ATTRIBUTES
+  if (attr_buff)
+    {
+    uint8_t *atop = attr_buff + scroll_top * cols;
+    memmove (atop, atop + cols, n * cols);
+    memset (atop + n * cols, 0, cols);
+    }
+#endif
+#if LCDTERM_FEATURE_MARQUEE
+  if (marquee_buff)
+    {
+    Char *mtop = marquee_buff + scroll_top * LCDTERM_MARQUEE_LEN;
+    memmove (mtop, mtop + LCDTERM_MARQUEE_LEN, n * LCDTERM_MARQUEE_LEN);
+    memset (mtop + n * LCDTERM_MARQUEE_LEN, 0, LCDTERM_MARQUEE_LEN);
+    memmove (marquee_len + scroll_top, marquee_len + scroll_top + 1, n);
+    marquee_len[scroll_bottom] = 0;
+    }
+  if (marquee_hw)
+    {
+    buff_to_display();
+    marquee_repaint();
+    cm.set_cursor (current_row, current_col);
+    return;
+    }
+#endif
+  if (scroll_top < stale_top) stale_top = scroll_top;
+  if (scroll_bottom > stale_bottom) stale_bottom = scroll_bottom;
+  }
+
+/**
+ * set_scroll_region
+ */
+void LCDTerm::set_scroll_region (uint8_t top, uint8_t bottom)
+  {
+  if (top >= bottom || bottom >= rows) return;
+  scroll_top = top;
+  scroll_bottom = bottom;
+  set_cursor (top, 0);
+  }
+
+/**
+ * fill_rect
+ */
+void LCDTerm::fill_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w,
+    Char c)
+  {
+  if (row >= rows || col >= cols) return;
+  if (h > rows - row) h = rows - row;
+  if (w > cols - col) w = cols - col;
+  for (uint8_t r = row; r < row + h; r++)
+    {
+    memset (curr_buff + r * col_stride + col, c, w);
+#if LCDTERM_FEATURE_ATTRIBUTES
+    if (attr_buff) memset (attr_buff + r * cols + col, curr_attr, w);
+#endif
+    }
+  paint_rect (row, col, h, w);
   cm.set_cursor (current_row, current_col);
   }
 
+/**
+ * copy_rect
+ * Rows are copied in the order that doesn't overwrite any part of the
+ * source before it has been copied; memmove takes care of overlap
+ * within a row.
+ */
+void LCDTerm::copy_rect (uint8_t src_row, uint8_t src_col, uint8_t h,
+    uint8_t w, uint8_t dst_row, uint8_t dst_col)
+  {
+  if (src_row >= rows || src_col >= cols) return;
+  if (dst_row >= rows || dst_col >= cols) return;
+  uint8_t max_row = src_row > dst_row ? src_row : dst_row;
+  uint8_t max_col = src_col > dst_col ? src_col : dst_col;
+  if (h > rows - max_row) h = rows - max_row;
+  if (w > cols - max_col) w = cols - max_col;
+  for (uint8_t i = 0; i < h; i++)
+    {
+    uint8_t r = dst_row > src_row ? h - 1 - i : i;
+    memmove (curr_buff + (dst_row + r) * col_stride + dst_col,
+      curr_buff + (src_row + r) * col_stride + src_col, w);
+#if LCDTERM_FEATURE_ATTRIBUTES
+    if (attr_buff)
+      memmove (attr_buff + (dst_row + r) * cols + dst_col,
+        attr_buff + (src_row + r) * cols + src_col, w);
+#endif
+    }
+  paint_rect (dst_row, dst_col, h, w);
+  cm.set_cursor (current_row, current_col);
+  }
+
+/**
+ * clear_to_eol
+ */
+void LCDTerm::clear_to_eol (void)
+  {
+  if (current_col < cols)
+    fill_rect (current_row, current_col, 1, cols - current_col, 0);
+  }
+
+/**
+ * clear_to_eos
+ */
+void LCDTerm::clear_to_eos (void)
+  {
+  clear_to_eol();
+  if (current_row < rows - 1)
+    fill_rect (current_row + 1, 0, rows - current_row - 1, cols, 0);
+  }
+
 /**
  * print_tab 
  */
 void LCDTerm::clear_buff (void)
   {
   memset (curr_buff, 0, rows * col_stride);
+  // The caller clears the display, so nothing on it is stale
+  stale_top = STALE_NONE;
+  stale_bottom = 0;
+#if LCDTERM_FEATURE_ATTRIBUTES
+  if (attr_buff) memset (attr_buff, 0, rows * cols);
+#endif
   }
 
 /**
@@ -272,10 +827,12 @@ void LCDTerm::clear_buff (void)
  */
 void LCDTerm::print_tab (void)
   {
+  // Don't go round forever if the cursor is stuck at the end of a line
+  uint8_t n = tab_space;
   do
     {
     print (' ');
-    } while ((current_col % tab_space) != 0);
+    } while ((current_col % tab_space) != 0 && --n);
   }
 
 /**
@@ -312,3 +869,610 @@ void LCDTerm::print_bell (void)
 
 
 
+
+/**
+ * set_escape_handler
+ */
+void LCDTerm::set_escape_handler (LCDTermEscHandler handler)
+  {
+#if LCDTERM_FEATURE_ESCAPES
+  esc_handler = handler;
+#else
+  (void)handler;
+#endif
+  }
+
+/**
+ * flush
+ */
+void LCDTerm::flush (void)
+  {
+  if (stale_top <= stale_bottom)
+    {
+    paint_rect (stale_top, 0, stale_bottom - stale_top + 1, cols);
+    stale_top = STALE_NONE;
+    stale_bottom = 0;
+    cm.set_cursor (current_row, current_col);
+    }
+  cm.flush();
+  }
+
+/**
+ * tick
+ */
+void LCDTerm::tick (unsigned long now)
+  {
+#if LCDTERM_FEATURE_MARQUEE
+  if (marquee_mode != LCDTERM_MARQUEE_OFF
+       && (now - marquee_last) >= marquee_interval)
+    {
+    marquee_last = now;
+    marquee_advance();
+    }
+#endif
+#if LCDTERM_FEATURE_ATTRIBUTES
+  if (attr_buff && (now - blink_last) >= LCDTERM_BLINK_INTERVAL)
+    {
+    blink_last = now;
+    blink_off = !blink_off;
+    if (attr_paint (LCDTERM_ATTR_BLINK))
+      cm.set_cursor (current_row, current_col);
+    }
+#endif
+#if !LCDTERM_FEATURE_MARQUEE && !LCDTERM_FEATURE_ATTRIBUTES
+  (void)now;
+#endif
+  }
+
+/**
+ * set_marquee
+ * The buffer for the full text of each row is only allocated the first
+ * time marquee mode is turned on, and then kept.
+ */
+void LCDTerm::set_marquee (uint8_t mode, uint16_t interval)
+  {
+#if LCDTERM_FEATURE_MARQUEE
+  if (mode > LCDTERM_MARQUEE_DISPLAY) return;
+  if (mode != LCDTERM_MARQUEE_OFF && !marquee_buff)
+    {
+    marquee_buff = (Char *)malloc (rows * (LCDTERM_MARQUEE_LEN + 1));
+    if (!marquee_buff) return;
+    marquee_len = marquee_buff + rows * LCDTERM_MARQUEE_LEN;
+    }
+  if (marquee_hw) cm.shift_home();
+  marquee_mode = mode;
+  if (current_col >= cols) current_col = cols - 1;
+  marquee_interval = interval ? interval : LCDTERM_MARQUEE_INTERVAL;
+  // Hardware shift only works if a row's DDRAM can hold a full line
+  marquee_hw = (mode == LCDTERM_MARQUEE_DISPLAY
+     && cm.get_shift_width() >= LCDTERM_MARQUEE_LEN);
+#if LCDTERM_FEATURE_ATTRIBUTES
+  // Marquee rows are written without attributes
+  if (attr_buff && mode != LCDTERM_MARQUEE_OFF)
+    memset (attr_buff, 0, rows * cols);
+#endif
+  // Whatever is on the screen now becomes the start of each row's text
+  if (marquee_buff)
+    {
+    marquee_clear();
+    for (uint8_t row = 0; row < rows; row++)
+      {
+      memcpy (marquee_buff + row * LCDTERM_MARQUEE_LEN,
+        curr_buff + row * col_stride, cols);
+      marquee_len[row] = cols;
+      while (marquee_len[row] > 0
+          && curr_buff[row * col_stride + marquee_len[row] - 1] == 0)
+        marquee_len[row]--;
+      }
+    }
+  buff_to_display();
+  cm.set_cursor (current_row, current_col);
+#else
+  (void)mode; (void)interval;
+#endif
+  }
+
+#if LCDTERM_FEATURE_ESCAPES
+
+/**
+ * escape_param_count
+ * Returns the number of parameter bytes that follow the command
+ * character of each escape sequence. This has to cover sequences that
+ * are handled by the escape handler, as well as our own, else we won't
+ * know where the sequence ends. Sequences we don't know at all are
+ * assumed to have no parameters. Numeric parameters are sent as the
+ * value plus 32, as in the VT52's cursor addressing, so that they are
+ * always printable.
+ */
+uint8_t LCDTerm::escape_param_count (Char cmd)
+  {
+  switch (cmd)
+    {
+    case 'm': return 2; // Marquee: mode, interval/50 msec
+    case 't': return 2; // Control code action: code, action
+    case 'Y': return 2; // Cursor address: row, col
+    case 'r': return 2; // Scroll region: top, bottom
+    case 'f': return 5; // Fill rectangle: row, col, h, w, char
+    case 'y': return 6; // Copy rectangle: row, col, h, w, to row, col
+    case 'S': return 1; // Snapshot autosave time, seconds
+    case 'F': return 1; // Frame mode: on/off
+    case 'a': return 1; // Attributes
+    case 'b': return LCDTERM_ESC_STRING; // Big digits: row, col, height, text
+    case 'T': return LCDTERM_ESC_STRING; // Clock time: YYYYMMDDhhmmss
+    case 'k': return LCDTERM_ESC_STRING; // Clock field: n, row, col, height, format
+    }
+  return 0;
+  }
+
+/**
+ * parse_escape
+ * Called for each byte after an ESC, until the sequence is complete.
+ */
+void LCDTerm::parse_escape (Char c)
+  {
+  if (esc_state == ESC_COMMAND)
+    {
+    esc_cmd = c;
+    esc_count = 0;
+    esc_wanted = escape_param_count (c);
+    if (esc_wanted == 0)
+      {
+      esc_state = ESC_NONE;
+      do_escape();
+      }
+    else
+      esc_state = ESC_PARAMS;
+    return;
+    }
+
+  if (esc_wanted == LCDTERM_ESC_STRING)
+    {
+    if (c < 32)
+      {
+      esc_state = ESC_NONE;
+      do_escape();
+      }
+    else if (esc_count < LCDTERM_ESC_MAX)
+      esc_params[esc_count++] = c;
+    return;
+    }
+
+  esc_params[esc_count++] = c;
+  if (esc_count >= esc_wanted)
+    {
+    esc_state = ESC_NONE;
+    do_escape();
+    }
+  }
+
+/**
+ * do_escape
+ * Act on a complete escape sequence.
+ */
+void LCDTerm::do_escape (void)
+  {
+  switch (esc_cmd)
+    {
+#if LCDTERM_FEATURE_MARQUEE
+    case 'm':
+      set_marquee (esc_params[0] - 32, (esc_params[1] - 32) * 50);
+      return;
+#endif
+    case 't':
+      set_control (esc_params[0] - 32, esc_params[1] - 32);
+      return;
+    case 'u':
+      reset_controls();
+      return;
+#if LCDTERM_FEATURE_REGIONS
+    case 'Y':
+      set_cursor (esc_params[0] - 32, esc_params[1] - 32);
+      return;
+    case 'J':
+      clear_to_eos();
+      return;
+    case 'K':
+      clear_to_eol();
+      return;
+    case 'r':
+      set_scroll_region (esc_params[0] - 32, esc_params[1] - 32);
+      return;
+    case 'f':
+      fill_rect (esc_params[0] - 32, esc_params[1] - 32,
+        esc_params[2] - 32, esc_params[3] - 32, esc_params[4]);
+      return;
+    case 'y':
+      copy_rect (esc_params[0] - 32, esc_params[1] - 32,
+        esc_params[2] - 32, esc_params[3] - 32,
+        esc_params[4] - 32, esc_params[5] - 32);
+      return;
+#endif
+#if LCDTERM_FEATURE_ATTRIBUTES
+    case 'a':
+      set_attr (esc_params[0] - 32);
+      return;
+#endif
+#if LCDTERM_FEATURE_BIGDIGITS
+    case 'b':
+      if (esc_count >= 3)
+        big_text (esc_params[0] - 32, esc_params[1] - 32,
+          esc_params[2] - 32, esc_params + 3, esc_count - 3);
+      return;
+#endif
+    }
+  if (esc_handler)
+    esc_handler (*this, esc_cmd, esc_params, esc_count);
+  }
+
+#endif
+
+#if LCDTERM_FEATURE_MARQUEE
+
+/**
+ * marquee_char
+ * Print a character in marquee mode. Nothing wraps: the row's full
+ * text is kept, up to LCDTERM_MARQUEE_LEN characters, and anything
+ * after that is discarded. current_col can run off the end of the
+ * display in this mode. A row that holds no more than will fit is
+ * displayed as usual; longer rows are left to marquee_advance().
+ */
+void LCDTerm::marquee_char (Char c)
+  {
+  if (current_col >= LCDTERM_MARQUEE_LEN) return;
+  marquee_buff [current_row * LCDTERM_MARQUEE_LEN + current_col] = c;
+  if (current_col >= marquee_len[current_row])
+    marquee_len[current_row] = current_col + 1;
+
+  if (marquee_hw)
+    {
+    // The hardware takes care of rotation; the text just goes into
+    //   the row's DDRAM line, wherever it's currently showing
+    if (current_col < cols)
+      curr_buff [current_row * col_stride + current_col] = c;
+    cm.write_offscreen_char (current_row, current_col, c);
+    }
+  else if (marquee_len[current_row] <= cols)
+    {
+    curr_buff [current_row * col_stride + current_col] = c;
+    if (!is_stale (current_row))
+      cm.write_char_at (current_row, current_col, c);
+    }
+  current_col++;
+  }
+
+/**
+ * marquee_advance
+ * Take one marquee step. With the hardware shift, that's one command,
+ * but only worth sending if some row needs it. Otherwise, work out what
+ * each long row should show at this step, and write only the cells
+ * that differ from what is showing already. curr_buff holds what's
+ * on the display, for rows that are rotating.
+ */
+void LCDTerm::marquee_advance (void)
+  {
+  uint8_t need = 0;
+  for (uint8_t row = 0; row < rows; row++)
+    if (marquee_len[row] > cols) need = 1;
+  if (!need) return;
+
+  marquee_step++;
+  if (marquee_hw)
+    {
+    cm.shift_left();
+    return;
+    }
+
+  for (uint8_t row = 0; row < rows; row++)
+    {
+    uint8_t len = marquee_len[row];
+    if (len <= cols) continue;
+    const Char *line = marquee_buff + row * LCDTERM_MARQUEE_LEN;
+    Char *disp = curr_buff + row * col_stride;
+    uint8_t period = len + LCDTERM_MARQUEE_GAP;
+    uint8_t pos = marquee_step % period;
+    // Changed cells are written in runs, to save on address commands
+    int8_t run_start = -1;
+    for (uint8_t col = 0; col <= cols; col++)
+      {
+      uint8_t changed = 0;
+      if (col < cols)
+        {
+        Char c = pos < len ? line[pos] : 0;
+        if (disp[col] != c)
+          {
+          disp[col] = c;
+          changed = 1;
+          }
+        if (++pos >= period) pos = 0;
+        }
+      if (changed && run_start < 0)
+        run_start = col;
+      else if (!changed && run_start >= 0)
+        {
+        cm.write_run (row, run_start, disp + run_start, col - run_start);
+        run_start = -1;
+        }
+      }
+    }
+  cm.set_cursor (current_row, current_col);
+  }
+
+/**
+ * marquee_repaint
+ * After the display has been cleared and repainted from curr_buff,
+ * put back the parts of each row's text that are off the right-hand
+ * edge, when using the hardware shift. Clearing the display undoes the
+ * shift, so the rotation starts again.
+ */
+void LCDTerm::marquee_repaint (void)
+  {
+  if (!marquee_hw) return;
+  for (uint8_t row = 0; row < rows; row++)
+    {
+    const Char *line = marquee_buff + row * LCDTERM_MARQUEE_LEN;
+    for (uint8_t col = cols; col < marquee_len[row]; col++)
+      cm.write_offscreen_char (row, col, line[col]);
+    }
+  }
+
+/**
+ * marquee_clear
+ * Forget the text of all rows. The caller is responsible for the
+ * display itself.
+ */
+void LCDTerm::marquee_clear (void)
+  {
+  if (!marquee_buff) return;
+  memset (marquee_buff, 0, rows * (LCDTERM_MARQUEE_LEN + 1));
+  marquee_step = 0;
+  }
+
+#endif
+
+#if LCDTERM_FEATURE_BIGDIGITS
+
+/**
+ * big_load
+ * Put the big digit segments into the CGRAM.
+ */
+void LCDTerm::big_load (void)
+  {
+  uint8_t bitmap[8];
+  for (uint8_t i = 0; i < 8; i++)
+    {
+    memcpy_P (bitmap, big_segments[i], 8);
+    cm.define_char (i, bitmap);
+    }
+  big_loaded = true;
+#if LCDTERM_FEATURE_ATTRIBUTES
+  // The inverted characters have gone. The caller repaints the inverse
+  //   cells, plain, once the segments are in the buffer -- until then,
+  //   inverse_slot() would see nothing using them, and take them back
+  memset (inv_chars, 0, sizeof (inv_chars));
+#endif
+  }
+
+/**
+ * big_text
+ * Each row of the big text is built up in full, and then handed to
+ * update_cells(), which writes only what has changed.
+ */
+void LCDTerm::big_text (uint8_t row, uint8_t col, uint8_t height,
+    const Char *s, uint8_t n)
+  {
+  if (row >= rows || col >= cols) return;
+  if (height != 3) height = 2;
+  // Loading the segments moves the cursor, as does writing anything
+  bool loaded = big_loaded;
+  bool changed = !loaded;
+  if (!loaded) big_load();
+
+  for (uint8_t r = 0; r < height && row + r < rows; r++)
+    {
+    Char line[BIG_MAX_WIDTH];
+    uint8_t len = 0;
+    bool wide = false; // The last character was a digit, or a space
+    for (uint8_t i = 0; i < n; i++)
+      {
+      Char c = s[i];
+      Char cells[3];
+      uint8_t w;
+      if (c >= '0' && c <= '9')
+        {
+        if (height == 3)
+          memcpy_P (cells, big_digits3[c - '0'] + r * 3, 3);
+        else
+          memcpy_P (cells, big_digits2[c - '0'] + r * 3, 3);
+        w = 3;
+        }
+      else if (c == ' ')
+        {
+        cells[0] = cells[1] = cells[2] = BIG____;
+        w = 3;
+        }
+      else if (c == ':')
+        {
+        cells[0] = (height == 3 && r == 1) ? BIG____ : BIG_DOT;
+        w = 1;
+        }
+      else
+        continue;
+
+      if (wide && w == 3 && len < BIG_MAX_WIDTH) line[len++] = BIG____;
+      for (uint8_t j = 0; j < w && len < BIG_MAX_WIDTH; j++)
+        line[len++] = cells[j];
+      wide = (w == 3);
+      }
+    if (len > cols - col) len = cols - col;
+    if (update_cells (row + r, col, line, len)) changed = true;
+    }
+#if LCDTERM_FEATURE_ATTRIBUTES
+  if (!loaded && attr_buff) attr_paint (LCDTERM_ATTR_INVERSE);
+#endif
+  if (changed) cm.set_cursor (current_row, current_col);
+  }
+
+#endif
+
+#if LCDTERM_FEATURE_ATTRIBUTES
+
+/**
+ * set_attr
+ */
+void LCDTerm::set_attr (uint8_t attr)
+  {
+  attr &= LCDTERM_ATTR_BLINK | LCDTERM_ATTR_INVERSE;
+  if (attr && !attr_buff)
+    {
+    attr_buff = (uint8_t *)malloc (rows * cols);
+    if (!attr_buff) return;
+    memset (attr_buff, 0, rows * cols);
+    }
+  curr_attr = attr;
+  }
+
+/**
+ * paint_attrs
+ */
+void LCDTerm::paint_attrs (void)
+  {
+  if (attr_buff) attr_paint (LCDTERM_ATTR_BLINK | LCDTERM_ATTR_INVERSE);
+  }
+
+/**
+ * attr_cell
+ * In the blanked half of its blink, an inverse cell is shown plain,
+ * rather than blank, which is easier to read.
+ */
+Char LCDTerm::attr_cell (uint16_t i)
+  {
+  Char c = curr_buff[i];
+  uint8_t attr = attr_buff[i];
+  if ((attr & LCDTERM_ATTR_BLINK) && blink_off)
+    return (attr & LCDTERM_ATTR_INVERSE) ? c : 0;
+  return (attr & LCDTERM_ATTR_INVERSE) ? inverse_char (c) : c;
+  }
+
+/**
+ * inverse_char
+ * A blank, inverted, is the solid block from the character ROM, and
+ * the other way round; anything else needs a user-defined character.
+ * A character that can't have one is shown as it is.
+ */
+Char LCDTerm::inverse_char (Char c)
+  {
+  if (c == 0 || c == ' ') return INVERSE_BLANK;
+  if (c == INVERSE_BLANK) return ' ';
+  uint8_t slot = inverse_slot (c);
+  // Codes 8-15 show the user-defined characters, as 0-7 do
+  return slot == INVERSE_NONE ? c : slot + 8;
+  }
+
+/**
+ * inverse_slot
+ * Return the user-defined character that holds the inverse of c,
+ * making it if need be, or INVERSE_NONE. A character that no cell
+ * shows any more is only given up when another is needed, because it
+ * might well be wanted again. The caller is responsible for putting
+ * the cursor back, because defining a character moves it.
+ */
+uint8_t LCDTerm::inverse_slot (Char c)
+  {
+  uint8_t slot = INVERSE_NONE;
+  for (uint8_t i = 0; i < 8; i++)
+    {
+    if (inv_chars[i] == c) return i;
+    if (!inv_chars[i] && slot == INVERSE_NONE) slot = i;
+    }
+  uint8_t bitmap[8];
+  if (!font5x7_glyph (c, bitmap)) return INVERSE_NONE;
+#if LCDTERM_FEATURE_BIGDIGITS
+  // The segments are given up only when nothing shows them, so that a
+  //   screen of big digits that is cleared and drawn again doesn't
+  //   have to load them again
+  if (big_loaded)
+    {
+    if (user_chars_shown() || stale_top <= stale_bottom) return INVERSE_NONE;
+    big_loaded = false;
+    }
+#endif
+
+  if (slot == INVERSE_NONE)
+    {
+    // A character that the panel still shows -- in a held frame, say --
+    //   is in use, whatever the buffer says
+    uint8_t used = user_chars_shown();
+    for (uint16_t i = 0; i < rows * cols; i++)
+      if (attr_buff[i] & LCDTERM_ATTR_INVERSE)
+        for (uint8_t j = 0; j < 8; j++)
+          if (inv_chars[j] == curr_buff[i]) used |= 1 << j;
+    for (uint8_t i = 0; i < 8 && slot == INVERSE_NONE; i++)
+      if (!(used & (1 << i))) slot = i;
+    if (slot == INVERSE_NONE) return INVERSE_NONE;
+    }
+
+  for (uint8_t row = 0; row < 8; row++)
+    bitmap[row] ^= 0x1F;
+  cm.define_char (slot, bitmap);
+  inv_chars[slot] = c;
+  return slot;
+  }
+
+/**
+ * user_chars_shown
+ * Return a bit for each user-defined character, 0-7, that the panel
+ * shows, or that a cell of the buffer holds as it is -- a big digit
+ * segment, or a code the host printed. The panel's copy is only to be
+ * had if the matrix keeps one; otherwise it shows what the buffer
+ * does, once the stale rows have been repainted. Only called once
+ * attr_buff has been allocated.
+ */
+uint8_t LCDTerm::user_chars_shown (void)
+  {
+  uint8_t used = 0;
+  const Char *shown = cm.get_shown();
+  for (uint16_t i = 0; i < rows * cols; i++)
+    {
+    Char c = curr_buff[i];
+    if (c >= 8 && c <= 15) used |= 1 << (c - 8);
+    // Cells with attributes are repainted by attr_paint(), whatever
+    //   they show now
+    c = shown && !attr_buff[i] ? shown[i] : 0;
+    if (c >= 8 && c <= 15) used |= 1 << (c - 8);
+    }
+  return used;
+  }
+
+/**
+ * attr_paint
+ * Write every cell that has any of the attributes in mask, in runs,
+ * except in rows that are waiting to be repainted anyway. Returns true
+ * if anything was written, in which case the caller should put the
+ * cursor back.
+ */
+bool LCDTerm::attr_paint (uint8_t mask)
+  {
+  bool changed = false;
+  for (uint8_t row = 0; row < rows; row++)
+    {
+    if (is_stale (row)) continue;
+    const uint8_t *attrs = attr_buff + row * cols;
+    int16_t run_start = -1;
+    for (uint8_t col = 0; col <= cols; col++)
+      {
+      if (col < cols && (attrs[col] & mask))
+        {
+        if (run_start < 0) run_start = col;
+        }
+      else if (run_start >= 0)
+        {
+        write_cells (row, run_start, 1, col - run_start);
+        run_start = -1;
+        changed = true;
+        }
+      }
+    }
+  return changed;
+  }
+
+#endif
@@ -31,21 +31,97 @@
 #pragma once
 
 #include "charactermatrix.h"
+#include "lcdfeatures.h"
 
 // These constants are used as the flags argument to the constructor
 // LF will be interpreted as CR/LF
 #define LCDTERM_LF_IS_CRLF  0x01
 // Backspace will be interpreted as DEL, and vice-versa
 #define LCDTERM_SWAP_BS_DEL 0x02
+// Text that reaches the end of a row is clipped, rather than wrapping
+//   onto the next -- see set_wrap()
+#define LCDTERM_NO_WRAP     0x04
 
 #define LCDTERM_NORMAL      0x00
-#define LCDTERM_NO_WRAP     0x01
+
+// Marquee modes, for set_marquee() and ESC m. In ROWS mode, each row
+//   that holds more text than will fit rotates on its own, by
+//   rewriting the cells that change. In DISPLAY mode, the whole
+//   display rotates, using the hardware's display shift -- one command
+//   per step -- if the hardware can do it, or as in ROWS mode if not.
+#define LCDTERM_MARQUEE_OFF     0
+#define LCDTERM_MARQUEE_ROWS    1
+#define LCDTERM_MARQUEE_DISPLAY 2
+
+// The longest line that a marquee row can hold
+#define LCDTERM_MARQUEE_LEN 40
+// Number of blank cells between the end of a rotating line and its start
+#define LCDTERM_MARQUEE_GAP 4
+// Time between marquee steps, in msec, if not otherwise specified
+#define LCDTERM_MARQUEE_INTERVAL 300
+
+// Cell attributes, for set_attr() and ESC a. A blinking cell is shown
+//   and then blanked, LCDTERM_BLINK_INTERVAL msec each, by the terminal
+//   itself; if it is also inverse, it is shown inverse and then plain,
+//   instead. The HD44780 can't invert a character, so an inverse cell
+//   shows a user-defined character that is an inverted copy of it --
+//   see set_attr().
+#define LCDTERM_ATTR_NONE    0x00
+#define LCDTERM_ATTR_BLINK   0x01
+#define LCDTERM_ATTR_INVERSE 0x02
+
+// Time that a blinking cell spends shown, or blank, in msec
+#define LCDTERM_BLINK_INTERVAL 500
+
+// Actions for control codes, for set_control() and ESC t. Every
+//   control code (0-31, and DEL) is looked up in a table of these, which
+//   the host can change, so the terminal can be made to suit whatever
+//   line endings the host sends. PRINT shows the code as a character,
+//   which is one way to get at the user-defined characters 1-7 -- not
+//   SOH, though, if the firmware picks alerts out of the input.
+#define LCDTERM_ACT_IGNORE        0
+#define LCDTERM_ACT_PRINT         1
+#define LCDTERM_ACT_BELL          2
+#define LCDTERM_ACT_BS            3
+#define LCDTERM_ACT_DEL           4
+#define LCDTERM_ACT_TAB           5
+#define LCDTERM_ACT_LF            6
+#define LCDTERM_ACT_CR            7
+#define LCDTERM_ACT_CRLF          8
+#define LCDTERM_ACT_FF            9
+#define LCDTERM_ACT_HOME          10
+#define LCDTERM_ACT_BACKLIGHT_OFF 11
+#define LCDTERM_ACT_BACKLIGHT_ON  12
+#define LCDTERM_ACT_CURSOR_OFF    13
+#define LCDTERM_ACT_CURSOR_ON     14
+#define LCDTERM_ACT_WRAP_OFF      15
+#define LCDTERM_ACT_WRAP_ON       16
+#define LCDTERM_ACT_MAX           16
+
+// Number of entries in the control code table: 0-31, and then DEL
+#define LCDTERM_CTRL_CODES 33
+
+// The longest parameter list that an escape sequence can have
+#define LCDTERM_ESC_MAX 24
+
+// Parameter count, from escape_param_count(), of an escape sequence
+//   that takes a string, terminated by any control character
+#define LCDTERM_ESC_STRING 0xFF
+
+class LCDTerm;
+
+/** A function that handles escape sequences that LCDTerm does not
+ *  act on itself. cmd is the character after the ESC, and params
+ *  are the parameter bytes exactly as received. */
+typedef void (*LCDTermEscHandler) (LCDTerm &term, Char cmd,
+    const Char *params, uint8_t n);
 
 class LCDTerm
   {
   public:
 
   LCDTerm (CharacterMatrix &cm, uint8_t flags = 0);
+  ~LCDTerm();
   void init (void);
 
   /** Print any character. Handle escapes, etc. */
@@ -54,8 +130,9 @@ class LCDTerm
   void print (const Char *s);
 
   /** Print a character that is known not to be part of an
-   *  escape sequence. The is quicker than print_normal_char(), 
-   *  but a bad idea unless you know it's not an escape. */
+   *  escape sequence. The is quicker than print(), but a bad idea
+   *  unless you know it's not an escape. Control codes are acted on
+   *  according to the control code table. */
   void print_nonescape_char (Char c);
   
   /** Print a line feed. If the flag LCDTERM_LF_IS_CRLF was set, 
@@ -107,13 +184,157 @@ class LCDTerm
   /** Send the cursor to the home position. */
   void home (void);
 
-  /** Scroll up the whole display, keeping the cursor in the same place. */
+  /** Scroll up the scroll region -- the whole display, unless
+   *  set_scroll_region() says otherwise -- keeping the cursor in the
+   *  same place. The display doesn't catch up until flush(), so that
+   *  a burst of scrolls costs only one repaint. */
   void scroll_up (void);
 
+  /** Limit scrolling to rows top to bottom, inclusive, so that the
+   *  rows outside stay put. A line feed on the bottom row of the
+   *  region scrolls the region; on the bottom row of the display,
+   *  outside the region, it does nothing. The cursor goes to the start
+   *  of the top row. */
+  void set_scroll_region (uint8_t top, uint8_t bottom);
+
+  /** Fill a rectangle of h rows by w columns, with its top-left corner
+   *  at row, col, with the character c. Zero gives blank cells. Parts
+   *  of the rectangle that are off the screen are ignored. */
+  void fill_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w, Char c);
+
+  /** Copy the rectangle of h rows by w columns at src_row, src_col so
+   *  that its top-left corner is at dst_row, dst_col. The rectangles
+   *  may overlap. */
+  void copy_rect (uint8_t src_row, uint8_t src_col, uint8_t h, uint8_t w,
+    uint8_t dst_row, uint8_t dst_col);
+
+  /** Blank the cursor row from the cursor to the end. */
+  void clear_to_eol (void);
+
+  /** Blank from the cursor to the end of the screen. */
+  void clear_to_eos (void);
+
+  /** Put the n characters of s on row, starting at col, as they
+   *  are -- control codes and all -- and without moving the cursor.
+   *  Anything past the end of the row is dropped. Only the cells that
+   *  differ from what is showing already are written. */
+  void put_text (uint8_t row, uint8_t col, const Char *s, uint8_t n);
+
+#if LCDTERM_FEATURE_BIGDIGITS
+  /** Draw the n characters of s as large digits, height rows high (2
+   *  or 3), with the top-left corner at row, col. Digits, and spaces,
+   *  are three columns wide, with a blank column between them; a colon
+   *  is one column wide. Anything else is ignored. Only the cells that
+   *  differ from what is showing already are written, so redrawing a
+   *  clock each second costs little. The cursor doesn't move. */
+  void big_text (uint8_t row, uint8_t col, uint8_t height, const Char *s,
+    uint8_t n);
+#endif
+
   /** Set the cursor position. Note that row and column numbers start
    *  at  zero. */
   void set_cursor (uint8_t row, uint8_t col);
 
+  /** Return the screen buffer, which holds rows x cols characters, row
+   *  by row. Empty cells are zero. A caller that changes the buffer
+   *  must call repaint() afterwards. */
+  Char *get_buff (void) { return curr_buff; }
+
+  /** Return the number of rows. */
+  uint8_t get_rows (void) { return rows; }
+
+  /** Return the number of columns. */
+  uint8_t get_cols (void) { return cols; }
+
+  /** Return the cursor row. */
+  uint8_t get_row (void) { return current_row; }
+
+  /** Return the cursor column. */
+  uint8_t get_col (void) { return current_col; }
+
+  /** Redraw the whole display from the screen buffer. */
+  void repaint (void);
+
+#if LCDTERM_FEATURE_ESCAPES
+  /** Return the number of parameter bytes that follow the command
+   *  character cmd of an escape sequence, or LCDTERM_ESC_STRING. This
+   *  is for anything that has to find the ends of escape sequences in
+   *  the input without parsing them -- the alert filter, say. */
+  static uint8_t escape_param_count (Char cmd);
+#endif
+
+  /** Put everything back on the display, after the hardware has been
+   *  restarted, and left blank -- the user-defined characters, the
+   *  text, and the cursor. */
+  void panel_reset (void);
+
+  /** Send anything that has been held back from the display --
+   *  scrolled rows, and whatever the CharacterMatrix buffers. Call
+   *  this once a batch of input has been printed. */
+  void flush (void);
+
+  /** Do any work that depends on the passage of time, like stepping
+   *  a marquee. Call this often, with the current time in msec. */
+  void tick (unsigned long now);
+
+  /** Set the marquee mode -- one of the LCDTERM_MARQUEE_XXX values --
+   *  and the time between steps, in msec (zero for the default). */
+  void set_marquee (uint8_t mode, uint16_t interval);
+
+  /** Turn wrapping on (the default) or off. With wrapping off, text
+   *  that reaches the end of a row is discarded until the next CR or
+   *  LF, so a field that is one character too long costs one character,
+   *  not a scroll. */
+  void set_wrap (bool on) { no_wrap = !on; }
+
+#if LCDTERM_FEATURE_ATTRIBUTES
+  /** Set the attributes -- LCDTERM_ATTR_XXX values, or'd together --
+   *  for the characters printed from now on, and for the cells that
+   *  fill_rect() and the clear-to-end escapes blank. The attributes go
+   *  with the characters when they scroll, or are copied, but text
+   *  put on the screen by put_text() or big_text() takes on whatever
+   *  attributes the cells already have. The first time an attribute
+   *  is set, rows x cols bytes are allocated to hold them.
+   *
+   *  Inverted characters are made in the HD44780's user-defined
+   *  characters, one for each different character that is showing
+   *  inverse, so at most eight can be shown at once (spaces don't
+   *  count). Big digits need all eight; while any are on the screen,
+   *  and for characters beyond the eighth, inverse cells are shown
+   *  plain. Clearing the screen leaves the segments loaded, in case
+   *  the same big digits are drawn again.
+   *  Attributes have no effect in marquee mode. */
+  void set_attr (uint8_t attr);
+
+  /** Return the attributes for characters printed from now on. */
+  uint8_t get_attr (void) { return curr_attr; }
+
+  /** Return the attributes of each cell, rows x cols, row by row, or
+   *  NULL if no attribute has ever been set. */
+  const uint8_t *get_attrs (void) { return attr_buff; }
+
+  /** Write the cells that have attributes to the display, as they
+   *  should look now. Call this after writing the screen buffer to the
+   *  display by some other route -- FrameMatrix::commit(), say -- and
+   *  then put the cursor back. */
+  void paint_attrs (void);
+#endif
+
+  /** Set the action -- one of the LCDTERM_ACT_XXX values -- for a
+   *  control code, 0-31 or 127. Anything else is ignored. */
+  void set_control (Char code, uint8_t action);
+
+  /** Return the action for a control code, 0-31 or 127. */
+  uint8_t get_control (Char code);
+
+  /** Put back the original actions for all the control codes, as set
+   *  by the flags given to the constructor. */
+  void reset_controls (void);
+
+  /** Set the function that handles escape sequences that LCDTerm
+   *  does not know about. */
+  void set_escape_handler (LCDTermEscHandler handler);
+
   protected:
 
   CharacterMatrix &cm;
@@ -121,15 +342,86 @@ class LCDTerm
   uint8_t current_col; // Current cursor column
   uint8_t rows;        // Number of rows available
   uint8_t cols;        // Number of columns available
+  uint8_t scroll_top;  // First row of the scroll region
+  uint8_t scroll_bottom; // Last row of the scroll region
   Char *curr_buff;
   int col_stride;      // Total memory occupied by a row
+  uint8_t stale_top;   // Rows stale_top to stale_bottom have scrolled,
+  uint8_t stale_bottom; //  and not yet been repainted; none if top > bottom
   bool lf_is_crlf;
   bool swap_bs_del;    // Swap backspace and del
+  bool no_wrap;        // Clip at the end of the row, rather than wrap
   /** Distance between tab stops. It's advisable to make this a divisor
    *  of the display width. */
   uint8_t tab_space;
+  /** Action for each control code; DEL is the last entry. */
+  uint8_t controls[LCDTERM_CTRL_CODES];
+
+#if LCDTERM_FEATURE_ESCAPES
+  uint8_t esc_state;   // Where we are in an escape sequence
+  Char esc_cmd;        // Command character of the current sequence
+  uint8_t esc_wanted;  // Number of parameter bytes it takes
+  uint8_t esc_count;   // Number of parameter bytes received so far
+  Char esc_params[LCDTERM_ESC_MAX];
+  LCDTermEscHandler esc_handler;
+#endif
+
+#if LCDTERM_FEATURE_BIGDIGITS
+  bool big_loaded;         // The big digit segments are in the CGRAM
+#endif
+
+#if LCDTERM_FEATURE_ATTRIBUTES
+  uint8_t *attr_buff;      // Attributes of each cell; NULL until used
+  uint8_t curr_attr;       // Attributes for characters printed now
+  bool blink_off;          // Blinking cells are blanked, at present
+  unsigned long blink_last; // Time blinking cells last changed
+  Char inv_chars[8];       // Character inverted in each user-defined
+                           //   character, or 0 if it is free
+#endif
+
+#if LCDTERM_FEATURE_MARQUEE
+  uint8_t marquee_mode;
+  uint8_t marquee_hw;      // Rotating with the hardware display shift
+  uint16_t marquee_interval;
+  uint16_t marquee_step;   // Number of steps taken so far
+  unsigned long marquee_last; // Time of the last step
+  Char *marquee_buff;      // Full text of each row, LCDTERM_MARQUEE_LEN each
+  uint8_t *marquee_len;    // Length of the text in each row
+#endif
 
   void buff_to_display (void);
+  void paint_rect (uint8_t row, uint8_t col, uint8_t h, uint8_t w);
+  void write_cells (uint8_t row, uint8_t col, uint8_t h, uint8_t w);
+#if LCDTERM_FEATURE_ATTRIBUTES
+  /** Return what cell i of the buffer should show on the display. */
+  Char cell (uint16_t i)
+    { return attr_buff && attr_buff[i] ? attr_cell (i) : curr_buff[i]; }
+  Char attr_cell (uint16_t i);
+  Char inverse_char (Char c);
+  uint8_t inverse_slot (Char c);
+  uint8_t user_chars_shown (void);
+  bool attr_paint (uint8_t mask);
+#else
+  Char cell (uint16_t i) { return curr_buff[i]; }
+#endif
   void clear_buff (void);
+  bool is_stale (uint8_t row)
+    { return row >= stale_top && row <= stale_bottom; }
+  void do_control (Char c, uint8_t action);
+  void advance_row (void);
+  bool update_cells (uint8_t row, uint8_t col, const Char *s, uint8_t n);
+#if LCDTERM_FEATURE_BIGDIGITS
+  void big_load (void);
+#endif
+#if LCDTERM_FEATURE_ESCAPES
+  void parse_escape (Char c);
+  void do_escape (void);
+#endif
+#if LCDTERM_FEATURE_MARQUEE
+  void marquee_char (Char c);
+  void marquee_advance (void);
+  void marquee_repaint (void);
+  void marquee_clear (void);
+#endif
   };
 
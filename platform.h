@@ -0,0 +1,64 @@
+/*============================================================================
+
+  platform.h
+
+  A very thin layer that lets the hardware-independent parts of this
+  program -- LCDTerm and the HD44780 command logic -- be built either
+  for the AVR, with the Arduino core, or natively on a Linux host.
+
+  On the AVR this header just pulls in Arduino.h. On a host, it
+  declares the handful of Arduino timing functions that the shared code
+  uses, which are implemented in platform_host.cpp, and makes the
+  PROGMEM macros work on ordinary memory.
+
+  platform_idle() waits, as cheaply as possible, for something to
+  happen. On the AVR that means idle sleep until the next interrupt.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#ifdef __AVR__
+
+#include <Arduino.h>
+#include <util/atomic.h>
+#include <avr/sleep.h>
+
+// Idle mode stops only the CPU clock, so the timers and the USB
+//   controller carry on, and their interrupts wake us
+static inline void platform_idle (void)
+  {
+  set_sleep_mode (SLEEP_MODE_IDLE);
+  sleep_enable();
+  sleep_cpu();
+  sleep_disable();
+  }
+
+#else
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Constant tables live in flash on the AVR; on the host, they're
+//   just constant
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define memcpy_P memcpy
+
+void delay (unsigned long ms);
+void delayMicroseconds (unsigned int us);
+unsigned long millis (void);
+unsigned long micros (void);
+void platform_idle (void);
+
+// There are no interrupt handlers to race with on the host, so an
+//   atomic block is just a block
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for (int _atomic_once = 1; _atomic_once; \
+    _atomic_once = 0)
+
+#endif
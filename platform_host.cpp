@@ -0,0 +1,77 @@
+/*==========================================================================
+
+    platform_host.cpp
+
+    Host (Linux) implementations of the Arduino timing functions, and
+    platform_idle(), declared in platform.h. This file is not part of
+    the firmware build.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#ifndef __AVR__
+
+#include <time.h>
+#include "platform.h"
+
+/**
+ * now_us
+ * Monotonic time in microseconds. Like the Arduino functions, the
+ * value simply wraps around when it overflows.
+ */
+static unsigned long now_us (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+  }
+
+/**
+ * delay
+ */
+void delay (unsigned long ms)
+  {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep (&ts, NULL);
+  }
+
+/**
+ * delayMicroseconds
+ */
+void delayMicroseconds (unsigned int us)
+  {
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000L;
+  nanosleep (&ts, NULL);
+  }
+
+/**
+ * millis
+ */
+unsigned long millis (void)
+  {
+  return now_us() / 1000;
+  }
+
+/**
+ * micros
+ */
+unsigned long micros (void)
+  {
+  return now_us();
+  }
+
+/**
+ * platform_idle
+ * There are no interrupts to wait for, so sleep for about as long as
+ * the AVR would, until its millis() timer woke it.
+ */
+void platform_idle (void)
+  {
+  delayMicroseconds (1000);
+  }
+
+#endif
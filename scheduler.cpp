@@ -0,0 +1,90 @@
+/*==========================================================================
+
+    scheduler.cpp
+
+    Implementation of the class that is specified in scheduler.h.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <stdint.h>
+#include "platform.h"
+
+#include "scheduler.h"
+
+/**
+ * Scheduler constructor
+ */
+Scheduler::Scheduler (void) :
+    n_tasks (0)
+  {
+  }
+
+/**
+ * add
+ * A timed task first runs one period after it was added.
+ */
+int8_t Scheduler::add (SchedFunc func, uint16_t period)
+  {
+  if (n_tasks >= SCHED_MAX_TASKS) return -1;
+  Task *t = &tasks[n_tasks];
+  t->func = func;
+  t->period = period;
+  t->due = millis() + period;
+  t->ready = false;
+  return n_tasks++;
+  }
+
+/**
+ * post
+ */
+void Scheduler::post (int8_t task)
+  {
+  if (task >= 0 && task < n_tasks)
+    tasks[task].ready = true;
+  }
+
+/**
+ * run
+ * Tasks run in the order they were added, so a task that posts one
+ * added after it gets that task run on the same pass; one added
+ * before it runs on the next pass, which is made straight away. A
+ * timed task that has fallen behind is not run repeatedly to catch
+ * up; its next run is one period from now.
+ */
+bool Scheduler::run (unsigned long now)
+  {
+  bool busy = false;
+  for (uint8_t i = 0; i < n_tasks; i++)
+    {
+    Task *t = &tasks[i];
+    if (t->period == SCHED_EVENT)
+      {
+      if (!t->ready) continue;
+      t->ready = t->func (now);
+      busy |= t->ready;
+      }
+    else if (t->period == SCHED_POLL)
+      {
+      busy |= t->func (now);
+      }
+    else if ((long)(now - t->due) >= 0)
+      {
+      t->due = now + t->period;
+      busy |= t->func (now);
+      }
+    }
+  for (uint8_t i = 0; i < n_tasks; i++)
+    busy |= tasks[i].ready;
+  return busy;
+  }
+
+/**
+ * run_or_idle
+ */
+void Scheduler::run_or_idle (void)
+  {
+  if (!run (millis()))
+    platform_idle();
+  }
+
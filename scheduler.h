@@ -0,0 +1,76 @@
+/*============================================================================
+
+  scheduler.h
+
+  A very small cooperative scheduler, to take the place of a main loop
+  that spins waiting for input. Each task is a function that is run
+  to completion, and should return quickly. A task is one of three
+  kinds, according to its period:
+
+  SCHED_POLL  -- run on every pass; for checking on hardware that has
+                 no way to tell us it needs attention (USB input)
+  SCHED_EVENT -- run only when some other task has called post() for
+                 it; for work that follows on from something else
+                 (parsing the input that has just arrived)
+  otherwise   -- run every so many msec (marquees, automatic saves)
+
+  A task returns true if it did something and has more to do straight
+  away -- an event task stays posted, and a poll task keeps the CPU
+  awake for another pass. When a whole pass finds nothing to do, the
+  CPU is put to sleep until the next interrupt, which on the AVR is
+  at most a millisecond away (the timer that drives millis()), or
+  sooner if USB data arrives.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define SCHED_POLL 0
+#define SCHED_EVENT 0xFFFF
+
+// Size of the task table
+#define SCHED_MAX_TASKS 8
+
+/** A task -- now is the time in msec; returns true if busy */
+typedef bool (*SchedFunc) (unsigned long now);
+
+class Scheduler
+  {
+  public:
+
+  Scheduler (void);
+
+  /** Add a task, with a period in msec, or SCHED_POLL or SCHED_EVENT.
+   *  Returns the task number, or -1 if the table is full. */
+  int8_t add (SchedFunc func, uint16_t period);
+
+  /** Mark a task as ready to run on the next pass. */
+  void post (int8_t task);
+
+  /** Run every task that is ready or due, once. Returns true if any
+   *  of them is still busy. */
+  bool run (unsigned long now);
+
+  /** Run one pass, and sleep if there is nothing left to do. Call
+   *  this from loop(). */
+  void run_or_idle (void);
+
+  protected:
+
+  struct Task
+    {
+    SchedFunc func;
+    uint16_t period;
+    unsigned long due;   // For timed tasks, the next time to run
+    bool ready;          // For event tasks, post() has been called
+    };
+
+  Task tasks[SCHED_MAX_TASKS];
+  uint8_t n_tasks;
+  };
+
@@ -0,0 +1,250 @@
+/*==========================================================================
+
+    snapshot.cpp
+
+    Implementation of the class that is specified in snapshot.h.
+
+    Each slot is laid out like this:
+
+    0     magic number -- anything else means the slot is empty
+    1-2   rows, cols of the screen that was saved
+    3-4   cursor row, column
+    5-6   sequence number, low byte first
+    7     checksum of bytes 1-6 and the screen
+    8...  the screen, rows x cols bytes
+
+    The magic number is written last, so a slot whose writing was
+    interrupted will not be mistaken for a complete one. The checksum
+    catches the case where an old slot is being overwritten, and the
+    magic number was never cleared.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include <Arduino.h>
+#include <avr/eeprom.h>
+
+#include "snapshot.h"
+
+// The first part of the EEPROM is left for settings
+#define SNAPSHOT_EEPROM_BASE 64
+#define SNAPSHOT_EEPROM_END (E2END + 1)
+
+#define SNAPSHOT_MAGIC 0x5A
+#define SNAPSHOT_HEADER 8
+
+// Offsets within a slot's header
+#define SNAP_MAGIC 0
+#define SNAP_ROWS 1
+#define SNAP_COLS 2
+#define SNAP_ROW 3
+#define SNAP_COL 4
+#define SNAP_SEQ 5
+#define SNAP_SUM 7
+
+#define SLOT_ADDR(slot) \
+  ((uint8_t *)(uintptr_t)(SNAPSHOT_EEPROM_BASE + (uint16_t)(slot) * slot_size))
+
+/**
+ * Snapshot constructor
+ */
+Snapshot::Snapshot (LCDTerm &term) :
+    term (term),
+    slots (0),
+    slot_size (0),
+    newest (-1),
+    newest_seq (0),
+    autosave (0),
+    dirty (false),
+    last_input (0)
+  {
+  }
+
+/**
+ * restore
+ */
+bool Snapshot::restore (void)
+  {
+  setup();
+  if (newest < 0) return false;
+
+  uint8_t *addr = SLOT_ADDR (newest);
+  eeprom_read_block (term.get_buff(), addr + SNAPSHOT_HEADER,
+    slot_size - SNAPSHOT_HEADER);
+  uint8_t row = eeprom_read_byte (addr + SNAP_ROW);
+  uint8_t col = eeprom_read_byte (addr + SNAP_COL);
+  term.set_cursor (row, col);
+  term.repaint();
+  return true;
+  }
+
+/**
+ * save
+ */
+void Snapshot::save (void)
+  {
+  setup();
+  dirty = false;
+  if (slots == 0) return;
+  if (newest >= 0 && same_as_slot (newest)) return;
+
+  uint8_t slot = newest < 0 ? 0 : (newest + 1) % slots;
+  uint16_t seq = newest_seq + 1;
+  uint8_t *addr = SLOT_ADDR (slot);
+  uint8_t header[SNAPSHOT_HEADER];
+  const Char *buff = term.get_buff();
+  uint16_t size = slot_size - SNAPSHOT_HEADER;
+
+  header[SNAP_MAGIC] = SNAPSHOT_MAGIC;
+  header[SNAP_ROWS] = term.get_rows();
+  header[SNAP_COLS] = term.get_cols();
+  header[SNAP_ROW] = term.get_row();
+  header[SNAP_COL] = term.get_col();
+  header[SNAP_SEQ] = seq & 0xFF;
+  header[SNAP_SEQ + 1] = seq >> 8;
+  header[SNAP_SUM] = checksum (buff, size,
+    checksum (header + 1, SNAP_SUM - 1, 0));
+
+  eeprom_update_byte (addr + SNAP_MAGIC, 0xFF);
+  eeprom_update_block (buff, addr + SNAPSHOT_HEADER, size);
+  eeprom_update_block (header + 1, addr + 1, SNAPSHOT_HEADER - 1);
+  eeprom_update_byte (addr + SNAP_MAGIC, SNAPSHOT_MAGIC);
+
+  newest = slot;
+  newest_seq = seq;
+  }
+
+/**
+ * erase
+ */
+void Snapshot::erase (void)
+  {
+  setup();
+  for (uint8_t slot = 0; slot < slots; slot++)
+    eeprom_update_byte (SLOT_ADDR (slot) + SNAP_MAGIC, 0xFF);
+  newest = -1;
+  }
+
+/**
+ * set_autosave
+ */
+void Snapshot::set_autosave (uint8_t seconds)
+  {
+  autosave = seconds;
+  }
+
+/**
+ * note_input
+ */
+void Snapshot::note_input (unsigned long now)
+  {
+  dirty = true;
+  last_input = now;
+  }
+
+/**
+ * tick
+ */
+void Snapshot::tick (unsigned long now)
+  {
+  if (autosave && dirty && (now - last_input) >= autosave * 1000UL)
+    save();
+  }
+
+/* =========================================================================
+       protected functions below this point
+=========================================================================*/
+
+/**
+ * setup
+ * Work out the slot layout, and find the newest snapshot. This can't
+ * be done in the constructor, which runs before the Arduino core has
+ * initialized the hardware, so it's done the first time it's needed.
+ */
+void Snapshot::setup (void)
+  {
+  if (slot_size) return;
+  slot_size = SNAPSHOT_HEADER + term.get_rows() * term.get_cols();
+  slots = (SNAPSHOT_EEPROM_END - SNAPSHOT_EEPROM_BASE) / slot_size;
+  find_newest();
+  }
+
+/**
+ * find_newest
+ * Sequence numbers wrap around, so "newer" means "ahead by less than
+ * half the range".
+ */
+void Snapshot::find_newest (void)
+  {
+  newest = -1;
+  for (uint8_t slot = 0; slot < slots; slot++)
+    {
+    uint16_t seq;
+    if (!slot_valid (slot, &seq)) continue;
+    if (newest < 0 || (int16_t)(seq - newest_seq) > 0)
+      {
+      newest = slot;
+      newest_seq = seq;
+      }
+    }
+  }
+
+/**
+ * slot_valid
+ * A slot is valid if it has the magic number, was saved from a screen
+ * of the same size as ours, and has the right checksum.
+ */
+bool Snapshot::slot_valid (uint8_t slot, uint16_t *seq)
+  {
+  uint8_t *addr = SLOT_ADDR (slot);
+  uint8_t header[SNAPSHOT_HEADER];
+  eeprom_read_block (header, addr, SNAPSHOT_HEADER);
+  if (header[SNAP_MAGIC] != SNAPSHOT_MAGIC) return false;
+  if (header[SNAP_ROWS] != term.get_rows()) return false;
+  if (header[SNAP_COLS] != term.get_cols()) return false;
+
+  uint8_t sum = checksum (header + 1, SNAP_SUM - 1, 0);
+  for (uint16_t i = SNAPSHOT_HEADER; i < slot_size; i++)
+    {
+    uint8_t b = eeprom_read_byte (addr + i);
+    sum = checksum (&b, 1, sum);
+    }
+  if (sum != header[SNAP_SUM]) return false;
+
+  *seq = header[SNAP_SEQ] | (header[SNAP_SEQ + 1] << 8);
+  return true;
+  }
+
+/**
+ * same_as_slot
+ * Compare the screen and cursor with a saved snapshot, to avoid wearing
+ * out the EEPROM saving the same thing over and over.
+ */
+bool Snapshot::same_as_slot (uint8_t slot)
+  {
+  uint8_t *addr = SLOT_ADDR (slot);
+  if (eeprom_read_byte (addr + SNAP_ROW) != term.get_row()) return false;
+  if (eeprom_read_byte (addr + SNAP_COL) != term.get_col()) return false;
+  const Char *buff = term.get_buff();
+  for (uint16_t i = SNAPSHOT_HEADER; i < slot_size; i++)
+    {
+    if (eeprom_read_byte (addr + i) != buff[i - SNAPSHOT_HEADER])
+      return false;
+    }
+  return true;
+  }
+
+/**
+ * checksum
+ * Rotate-and-xor, which, unlike a plain sum, notices bytes that have
+ * been swapped around.
+ */
+uint8_t Snapshot::checksum (const uint8_t *p, uint16_t n, uint8_t sum)
+  {
+  while (n--)
+    {
+    sum = ((sum << 1) | (sum >> 7)) ^ *p++;
+    }
+  return sum;
+  }
+
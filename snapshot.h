@@ -0,0 +1,77 @@
+/*============================================================================
+
+  snapshot.h
+
+  Saves the contents of an LCDTerm's screen to EEPROM, and puts them back
+  at power-up, so that the panel shows something useful straight away,
+  rather than a banner or nothing at all, while the host boots.
+
+  EEPROM cells only survive about 100,000 writes, so the snapshots are
+  spread around the whole EEPROM: it is divided into as many slots as
+  will fit, and each snapshot goes into the slot after the newest one.
+  Each slot carries a sequence number, so that the newest can be found
+  at start-up, and a checksum, so that a snapshot that was only half
+  written when the power went is ignored. A snapshot that is the same
+  as the newest one already saved is not written at all.
+
+  A snapshot can be taken on request, or automatically once the screen
+  has been left alone for a while after it changed.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "lcdterm.h"
+
+class Snapshot
+  {
+  public:
+
+  Snapshot (LCDTerm &term);
+
+  /** Load the newest valid snapshot into the terminal and display it.
+   *  Returns false if there is no snapshot for a screen of this size. */
+  bool restore (void);
+
+  /** Save the terminal's screen, unless it's the same as the newest
+   *  snapshot already saved. */
+  void save (void);
+
+  /** Invalidate all snapshots, so that nothing is restored at the next
+   *  power-up. */
+  void erase (void);
+
+  /** Set the time, in seconds, that the screen must be left alone after
+   *  a change before it is saved automatically. Zero turns automatic
+   *  saving off. */
+  void set_autosave (uint8_t seconds);
+
+  /** Tell the snapshot that the terminal has received input. */
+  void note_input (unsigned long now);
+
+  /** Take an automatic snapshot if it's time to. Call this often, with
+   *  the current time in msec. */
+  void tick (unsigned long now);
+
+  protected:
+
+  LCDTerm &term;
+  uint8_t slots;        // Number of slots that fit in the EEPROM
+  uint16_t slot_size;   // Header plus screen
+  int8_t newest;        // Slot holding the newest snapshot, or -1
+  uint16_t newest_seq;  // ...and its sequence number
+  uint8_t autosave;     // Seconds of idle time before saving, or zero
+  bool dirty;           // Input received since the last save
+  unsigned long last_input;
+
+  void setup (void);
+  void find_newest (void);
+  bool slot_valid (uint8_t slot, uint16_t *seq);
+  bool same_as_slot (uint8_t slot);
+  uint8_t checksum (const uint8_t *p, uint16_t n, uint8_t sum);
+  };
+
@@ -1,18 +1,20 @@
 #!/bin/bash
 
 # A simple script that uses the usb-lcd firmware to display the
-#  time, load average, and largest CPU user, at intervals of 5 sec
+#  time, load average, and largest CPU user, at intervals of 5 sec.
+#  Each screen is sent as a frame, so the firmware only rewrites the
+#  cells that have changed, and the panel doesn't flicker.
 
 DEVICE=/dev/ttyACM0
 
-# Turn off the cursor
-printf "\x13" > $DEVICE
+# Turn off the cursor, and turn on frame mode
+printf "\x13\eF!" > $DEVICE
 
 while true ; do
   TIME=`date "+%I:%M%p"`
   LA=`cut -f 1 -d ' ' < /proc/loadavg`
   TOP=`top -b -n 1 -w 100 | head -8 | tail -1 | cut -b 70-86`
-  printf "\f$TIME $LA\r\n$TOP" > $DEVICE 
+  printf "\f$TIME $LA\r\n$TOP\e." > $DEVICE 
   sleep 5 
 done
 
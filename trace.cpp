@@ -0,0 +1,74 @@
+/*==========================================================================
+
+    trace.cpp
+
+    Implementation of the functions that are specified in trace.h.
+
+    Events are only ever recorded from the main loop, not from
+    interrupt handlers, so there's no need to guard the ring.
+
+    Copyright (c)2021 Kevin Boone, GPL v3.0
+
+============================================================================*/
+#include "platform.h"
+#include "trace.h"
+
+#if LCD_FEATURE_TRACE
+
+static TraceEvent ring[TRACE_EVENTS];
+static uint8_t head;   // Where the next event goes
+static uint8_t count;  // Number of events in the ring
+static uint16_t lost;
+
+/**
+ * trace_event
+ */
+void trace_event (uint8_t type, uint8_t arg)
+  {
+  TraceEvent *e = &ring[head];
+  e->time = micros();
+  e->type = type;
+  e->arg = arg;
+  if (++head == TRACE_EVENTS) head = 0;
+  if (count < TRACE_EVENTS)
+    count++;
+  else if (lost < 0xFFFF)
+    lost++;
+  }
+
+/**
+ * trace_count
+ */
+uint8_t trace_count (void)
+  {
+  return count;
+  }
+
+/**
+ * trace_lost
+ */
+uint16_t trace_lost (void)
+  {
+  return lost;
+  }
+
+/**
+ * trace_get
+ */
+void trace_get (uint8_t n, TraceEvent *e)
+  {
+  uint16_t i = (uint16_t)head + TRACE_EVENTS - count + n;
+  *e = ring[i % TRACE_EVENTS];
+  }
+
+/**
+ * trace_clear
+ */
+void trace_clear (void)
+  {
+  head = 0;
+  count = 0;
+  lost = 0;
+  }
+
+#endif
@@ -0,0 +1,72 @@
+/*============================================================================
+
+  trace.h
+
+  A record of what the firmware has been doing, and when, for finding
+  out where the time goes between the host sending a byte and the
+  panel showing it. Each event is a type, a one-byte argument, and the
+  time from micros(). The events go into a fixed ring in RAM, so
+  only the most recent TRACE_EVENTS are kept.
+
+  Tracing is built in only if LCD_FEATURE_TRACE is set (see
+  lcdfeatures.h); otherwise the TRACE() macro expands to nothing, and
+  costs nothing. The board sends the ring to the host in response to
+  ESC q, and host/lcdtrace turns that into latency histograms.
+
+  Copyright (c)2021 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "lcdfeatures.h"
+
+// Event types. These are printable, so the dump can use them as-is
+#define TRACE_RX          'R' // Byte read from the host; arg is the byte
+#define TRACE_PARSED      'P' // Byte dealt with; arg is the byte
+#define TRACE_FLUSH_START 'F' // Start of a bulk write to the panel
+#define TRACE_FLUSH_END   'f' // ...and the end
+#define TRACE_SCROLL      'S' // Scroll; arg is the top row scrolled
+#define TRACE_CLEAR       'C' // Screen cleared
+#define TRACE_I2C_ERROR   'E' // I2C write failed; arg is the status
+#define TRACE_RECOVER     'V' // Panel restarted after errors; arg is 1 if OK
+
+// Number of events kept, at most 255. Each takes six bytes of RAM
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 64
+#endif
+
+typedef struct
+  {
+  uint32_t time;  // micros()
+  uint8_t type;
+  uint8_t arg;
+  } TraceEvent;
+
+#if LCD_FEATURE_TRACE
+
+#define TRACE(type, arg) trace_event ((type), (arg))
+
+/** Record an event. */
+void trace_event (uint8_t type, uint8_t arg);
+
+/** Return the number of events in the ring. */
+uint8_t trace_count (void);
+
+/** Return the number of events that have been overwritten since the
+ *  last trace_clear(), because the ring was full. */
+uint16_t trace_lost (void);
+
+/** Get event n, counting from the oldest. */
+void trace_get (uint8_t n, TraceEvent *e);
+
+/** Empty the ring. */
+void trace_clear (void);
+
+#else
+
+#define TRACE(type, arg)
+
+#endif
@@ -14,8 +14,30 @@ Distributed according to the terms of the GPL, v3.0
 
 #include <Arduino.h>
 #include <HardwareSerial.h>
+#ifdef LCD_PARALLEL
+#include "lcdparallel.h" 
+#else
 #include "lcd8574arduino.h" 
+#endif
 #include "lcdterm.h" 
+#include "lcdfeatures.h" 
+#include "scheduler.h" 
+#if LCD_FEATURE_ALERTS
+#include "alert.h" 
+#endif
+#if LCD_FEATURE_FRAMES
+#include "frame.h" 
+#endif
+#if LCD_FEATURE_CLOCK
+#include "clock.h" 
+#endif
+#include "trace.h" 
+#if LCD_FEATURE_SNAPSHOT
+#include "snapshot.h" 
+#endif
+#if LCDTERM_FEATURE_ESCAPES
+#include <avr/eeprom.h>
+#endif
 
 #define I2C_ADDR 0x27
 #define LCD_ROWS 4
@@ -23,49 +45,498 @@ Distributed according to the terms of the GPL, v3.0
 
 #define BANNER "usb-lcd\r\n(c)2021 K Boone"
 
+// Size of the receive ring, which must be a power of two no more than
+//   128, and the most bytes that are parsed before the other tasks get
+//   a turn
+#define RX_BUFF_SIZE 64
+#define PARSE_BUDGET 16
+
+// How often the periodic tasks run, msec
+#define TICK_PERIOD 10
+#define AUTOSAVE_PERIOD 250
+// The longest that scrolled rows wait to be repainted while input
+//   keeps arriving, msec
+#define FLUSH_INTERVAL 40
+// How often to bring the clock up to date, msec
+#define CLOCK_PERIOD 100
+// How often to check whether the panel needs recovering, msec
+#define RECOVER_PERIOD 20
+// A frame is shown once the input has been idle for this long, msec,
+//   if the host doesn't end it with ESC .
+#define FRAME_IDLE 50
+
+// Settings are kept in the first 64 bytes of EEPROM; snapshots go
+//   after that. The control code table is a marker byte, followed by
+//   the action for each code, in the order LCDTerm keeps them
+#define SETTINGS_CONTROLS ((uint8_t *)0)
+#define SETTINGS_CONTROLS_MAGIC 0xC7
+
+// Where the input comes from. Building with LCD_INPUT_UART reads the
+//   hardware UART instead of USB; this is for running the firmware
+//   under a simulator ("make sim-profile"), which can't do USB
+#ifdef LCD_INPUT_UART
+#define LCD_INPUT Serial1
+#else
+#define LCD_INPUT Serial
+#endif
+
 // Create LCD panel instance, specifying size
+#ifdef LCD_PARALLEL
+// D4-D7 on A3-A0 (PF4-PF7), RS on pin 8 (PB4), E on pin 9 (PB5), E2
+//   (40x4 panels only) on pin 10 (PB6), and no backlight control
+const LCDParallelPins pins = { &PORTF, &DDRF, 4, 0, 0, 0,
+    &PORTB, &DDRB, _BV(4), _BV(5), 0, 0, 0, _BV(6) };
+LCDParallel lcd (pins, LCD_COLS, LCD_ROWS);
+#else
 LCD8574Arduino lcd (I2C_ADDR, LCD_COLS, LCD_ROWS);
-LCDTerm term (lcd, LCDTERM_LF_IS_CRLF);
+#endif
+
+// Urgent alerts are shown over the top of what the terminal writes
+#if LCD_FEATURE_ALERTS
+AlertOverlay alerts (lcd);
+#define LCD_PANEL alerts
+#else
+#define LCD_PANEL lcd
+#endif
+
+// Frames are held back from the panel, alerts included, until they
+//   are complete
+#if LCD_FEATURE_FRAMES
+FrameMatrix frames (LCD_PANEL);
+LCDTerm term (frames, LCDTERM_LF_IS_CRLF);
+#else
+LCDTerm term (LCD_PANEL, LCDTERM_LF_IS_CRLF);
+#endif
+
+#if LCD_FEATURE_SNAPSHOT
+Snapshot snapshot (term);
+#endif
+
+#if LCD_FEATURE_CLOCK
+Clock lcd_clock (term);
+#endif
 
+#if LCD_FEATURE_BANNER
 // Clear banner will be set after the initial banner is cleared,
 // after receiving the first character from USB
 bool cleared_banner = false;
+#endif
+
+Scheduler sched;
+int8_t alert_task;
+int8_t parse_task;
+int8_t flush_task;
+
+unsigned long last_flush;
+#if LCD_FEATURE_FRAMES
+unsigned long last_input;
+#endif
+
+// Bytes that have been taken from the host, but not yet parsed. The
+//   indices run freely, and are masked when used
+Char rx_buff[RX_BUFF_SIZE];
+uint8_t rx_head;
+uint8_t rx_tail;
+
+#if LCDTERM_FEATURE_ESCAPES
+/**
+ * control_code
+ * The code for each entry in the control code table
+ */
+static Char control_code (uint8_t i)
+  {
+  return i == LCDTERM_CTRL_CODES - 1 ? 127 : i;
+  }
+
+/**
+ * save_controls
+ * Write the control code table to EEPROM. The marker is written last,
+ * so a half-written table is not used.
+ */
+void save_controls (void)
+  {
+  eeprom_update_byte (SETTINGS_CONTROLS, 0xFF);
+  for (uint8_t i = 0; i < LCDTERM_CTRL_CODES; i++)
+    eeprom_update_byte (SETTINGS_CONTROLS + 1 + i,
+      term.get_control (control_code (i)));
+  eeprom_update_byte (SETTINGS_CONTROLS, SETTINGS_CONTROLS_MAGIC);
+  }
+
+/**
+ * load_controls
+ * Read the control code table from EEPROM, if one was saved.
+ */
+void load_controls (void)
+  {
+  if (eeprom_read_byte (SETTINGS_CONTROLS) != SETTINGS_CONTROLS_MAGIC)
+    return;
+  for (uint8_t i = 0; i < LCDTERM_CTRL_CODES; i++)
+    term.set_control (control_code (i),
+      eeprom_read_byte (SETTINGS_CONTROLS + 1 + i));
+  }
+#endif
+
+#if LCD_FEATURE_TRACE
+/**
+ * dump_trace
+ * Send the trace ring to the host, oldest event first, and empty it.
+ * The format is meant for host/lcdtrace, but is readable enough as
+ * it is: a header line with the number of events and the number
+ * lost, then one line per event -- time in usec, type, argument.
+ */
+void dump_trace (void)
+  {
+  uint8_t n = trace_count();
+  LCD_INPUT.print ("trace ");
+  LCD_INPUT.print (n);
+  LCD_INPUT.print (' ');
+  LCD_INPUT.println (trace_lost());
+  for (uint8_t i = 0; i < n; i++)
+    {
+    TraceEvent e;
+    trace_get (i, &e);
+    LCD_INPUT.print (e.time);
+    LCD_INPUT.print (' ');
+    LCD_INPUT.write (e.type);
+    LCD_INPUT.print (' ');
+    LCD_INPUT.println (e.arg);
+    }
+  LCD_INPUT.println ("end");
+  trace_clear();
+  }
+#endif
+
+#if LCD_FEATURE_FRAMES
+/**
+ * commit_frame
+ * Show the frame that the terminal has built up, if there is one.
+ */
+void commit_frame (void)
+  {
+  if (!frames.holding()) return;
+  // Anything the terminal has held back is part of the frame
+  term.flush();
+  TRACE (TRACE_FLUSH_START, 0);
+#if LCDTERM_FEATURE_ATTRIBUTES
+  // Cells with attributes don't show what is in the buffer, so the
+  //   terminal paints them -- only those that have changed get written
+  frames.commit (term.get_buff(), term.get_attrs());
+  term.paint_attrs();
+#else
+  frames.commit (term.get_buff());
+#endif
+  TRACE (TRACE_FLUSH_END, 0);
+  term.set_cursor (term.get_row(), term.get_col());
+  }
+#endif
+
+#if LCD_FEATURE_RECOVERY
+/**
+ * report_status
+ * Tell the host how the panel is getting on: a single line with the
+ * number of failed writes to the panel, and the number of times it
+ * has been recovered, since reset.
+ */
+void report_status (void)
+  {
+  LCD_INPUT.print ("status ");
+  LCD_INPUT.print (lcd.get_bus_errors());
+  LCD_INPUT.print (' ');
+  LCD_INPUT.println (lcd.get_recoveries());
+  }
+#endif
+
+/**
+ * handle_escape
+ * Act on the escape sequences that concern the board, rather than the
+ * terminal.
+ */
+void handle_escape (LCDTerm &term, Char cmd, const Char *params, uint8_t n)
+  {
+  (void)term; (void)params; (void)n;
+  switch (cmd)
+    {
+#if LCDTERM_FEATURE_ESCAPES
+    case 'w': // Save the control code table to EEPROM
+      save_controls();
+      break;
+#endif
+#if LCD_FEATURE_TRACE
+    case 'q': // Send the trace to the host
+      dump_trace();
+      break;
+#endif
+#if LCD_FEATURE_SNAPSHOT
+    case 's': // Save the screen to EEPROM now
+      snapshot.save();
+      break;
+    case 'S': // Set automatic save time, seconds
+      snapshot.set_autosave (params[0] - 32);
+      break;
+    case 'z': // Forget any saved screen
+      snapshot.erase();
+      break;
+#endif
+#if LCD_FEATURE_RECOVERY
+    case '?': // Report errors and recoveries
+      report_status();
+      break;
+#endif
+#if LCD_FEATURE_CLOCK
+    case 'T': // Set the clock
+      lcd_clock.set (params, n, millis());
+      break;
+    case 'k': // Show a clock field
+      if (n >= 4)
+        lcd_clock.set_field (params[0] - 32, params[1] - 32, params[2] - 32,
+          params[3] - 32, params + 4, n - 4);
+      break;
+#endif
+#if LCD_FEATURE_FRAMES
+    case 'F': // Frame mode on or off
+      frames.set_enabled (params[0] - 32);
+      if (!frames.is_enabled()) commit_frame();
+      break;
+    case '.': // End of frame
+      commit_frame();
+      break;
+#endif
+    }
+  }
+
+/**
+ * task_ingest
+ * Take whatever the host has sent, as long as there's room for it.
+ * Emptying the USB endpoint quickly lets the host get on with sending
+ * the next packet while we parse this one. Alert packets are taken out
+ * here, so that they don't wait behind the rest.
+ */
+bool task_ingest (unsigned long now)
+  {
+  (void)now;
+  bool got = false;
+  while ((uint8_t)(rx_head - rx_tail) < RX_BUFF_SIZE
+      && LCD_INPUT.available())
+    {
+    Char c = LCD_INPUT.read();
+#if LCD_FEATURE_ALERTS
+    if (alerts.take (c))
+      {
+      if (alerts.ready()) sched.post (alert_task);
+      continue;
+      }
+#endif
+    // Traced here, rather than when the byte is parsed, so that the
+    //   time it spends waiting in rx_buff counts
+    TRACE (TRACE_RX, c);
+    rx_buff[rx_head++ & (RX_BUFF_SIZE - 1)] = c;
+    got = true;
+    }
+  if (got) sched.post (parse_task);
+  return false;
+  }
+
+#if LCD_FEATURE_ALERTS
+/**
+ * task_alert
+ * Show an alert that has just arrived, before any more of the
+ * ordinary input is parsed.
+ */
+bool task_alert (unsigned long now)
+  {
+#if LCD_FEATURE_FRAMES
+  // The terminal's buffer may hold a frame that hasn't been shown yet
+  alerts.apply (frames.get_shown(), now);
+#else
+  alerts.apply (term.get_buff(), now);
+#endif
+  term.set_cursor (term.get_row(), term.get_col());
+  term.flush();
+  return false;
+  }
+#endif
+
+/**
+ * task_parse
+ * Display up to PARSE_BUDGET bytes from the receive ring, so that a
+ * long burst from the host doesn't hold up the other tasks.
+ */
+bool task_parse (unsigned long now)
+  {
+#if LCD_FEATURE_BANNER
+  // Clear the banner if necessary
+  if (!cleared_banner)
+    {
+    term.clear();
+    cleared_banner = true;
+    }
+#endif
+
+  for (uint8_t n = 0; n < PARSE_BUDGET && rx_tail != rx_head; n++)
+    {
+    Char c = rx_buff[rx_tail++ & (RX_BUFF_SIZE - 1)];
+    term.print (c);
+    TRACE (TRACE_PARSED, c);
+    }
+#if LCD_FEATURE_SNAPSHOT
+  snapshot.note_input (millis());
+#endif
+#if LCD_FEATURE_FRAMES
+  last_input = millis();
+#endif
+  // Scrolled rows are repainted when the input runs out, so that a
+  //   burst of lines costs one repaint -- but not too seldom, if the
+  //   input never does run out
+  if (rx_tail == rx_head || (now - last_flush) >= FLUSH_INTERVAL)
+    sched.post (flush_task);
+  return rx_tail != rx_head;
+  }
+
+/**
+ * task_flush
+ * Send anything the terminal has held back, once a batch of input has
+ * been dealt with.
+ */
+bool task_flush (unsigned long now)
+  {
+  last_flush = now;
+  term.flush();
+  return false;
+  }
+
+/**
+ * task_tick
+ * Keep anything that moves (marquees, bell flashes, etc) moving.
+ */
+bool task_tick (unsigned long now)
+  {
+  term.tick (now);
+#if LCD_FEATURE_FRAMES
+  // A frame that the host didn't end is shown once the input stops
+  if (frames.holding() && rx_tail == rx_head
+      && (now - last_input) >= FRAME_IDLE)
+    {
+    commit_frame();
+    term.flush();
+    }
+#endif
+#if LCD_FEATURE_ALERTS
+  if (alerts.tick (now))
+    {
+    term.set_cursor (term.get_row(), term.get_col());
+    term.flush();
+    }
+#endif
+  return false;
+  }
+
+#if LCD_FEATURE_CLOCK
+/**
+ * task_clock
+ * The clock only writes to the panel when something has changed, so
+ * it can be brought up to date well inside each second.
+ */
+bool task_clock (unsigned long now)
+  {
+  lcd_clock.tick (now);
+  return false;
+  }
+#endif
+
+#if LCD_FEATURE_RECOVERY
+/**
+ * task_recover
+ * If a write to the panel has failed, the panel is probably showing
+ * garbage by now. Start it again, and put back what should be on it. A
+ * panel that doesn't answer at all is tried again next time.
+ */
+bool task_recover (unsigned long now)
+  {
+  (void)now;
+  if (!lcd.bus_failed()) return false;
+  uint8_t ok = lcd.recover();
+  TRACE (TRACE_RECOVER, ok);
+  if (!ok) return false;
+  term.panel_reset();
+#if LCD_FEATURE_FRAMES
+  commit_frame();
+#endif
+  term.flush();
+  return false;
+  }
+#endif
+
+#if LCD_FEATURE_SNAPSHOT
+/**
+ * task_autosave
+ */
+bool task_autosave (unsigned long now)
+  {
+  snapshot.tick (now);
+  return false;
+  }
+#endif
 
 /** 
  * setup
- * Initialize the USB port and the LCD panel
+ * Initialize the USB port and the LCD panel, and set up the tasks.
+ * If a screen was saved in EEPROM, show that rather than the banner --
+ * it's likely to be more use than a blank screen while the host gets
+ * going.
  */
 void setup()
   {
-  Serial.begin (57600); 
+  LCD_INPUT.begin (57600); 
+
+  // The order matters: tasks run in this order on each pass, so input
+  //   that has just arrived is parsed and flushed on the same pass
+  sched.add (task_ingest, SCHED_POLL);
+#if LCD_FEATURE_ALERTS
+  alert_task = sched.add (task_alert, SCHED_EVENT);
+#endif
+  parse_task = sched.add (task_parse, SCHED_EVENT);
+  flush_task = sched.add (task_flush, SCHED_EVENT);
+  sched.add (task_tick, TICK_PERIOD);
+#if LCD_FEATURE_CLOCK
+  sched.add (task_clock, CLOCK_PERIOD);
+#endif
+#if LCD_FEATURE_RECOVERY
+  sched.add (task_recover, RECOVER_PERIOD);
+#endif
+#if LCD_FEATURE_SNAPSHOT
+  sched.add (task_autosave, AUTOSAVE_PERIOD);
+#endif
 
   term.init();
   term.backlight_on();
   term.cursor_on();
+  term.set_escape_handler (handle_escape);
+#if LCDTERM_FEATURE_ESCAPES
+  load_controls();
+#endif
+#if LCD_FEATURE_SNAPSHOT
+  if (snapshot.restore())
+    {
+#if LCD_FEATURE_BANNER
+    cleared_banner = true;
+#endif
+    return;
+    }
+#endif
+#if LCD_FEATURE_BANNER
   term.print ((Char *)BANNER);
+#endif
   }
 
 
 /** 
  * loop 
- * Repeat every time a character is received 
+ * Run whatever tasks need running, then sleep until the next
+ * interrupt. The timer that drives millis() wakes us every msec or
+ * so, and so does the arrival of data from the host.
  */
 void loop()
   {
-  Serial.flush();
-
-  // Wait until a character has been received
-  while (!Serial.available());
-
-  // Clear the banner if necessary
-  if (!cleared_banner)
-    {
-    term.clear();
-    cleared_banner = true;
-    }
-
-  // Read and display the character
-  uint8_t c = Serial.read();
-  term.print (c);
+  sched.run_or_idle();
   }
 